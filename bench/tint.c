@@ -0,0 +1,170 @@
+/*
+ * bench/tint.c
+ * Times the album-art tint kernels from tint.h against each other and
+ * against the double-precision greyscale loop they replaced, and
+ * checks every SIMD path against the scalar one.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -o tint-bench bench/tint.c && ./tint-bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../tint.h"
+
+#define CHECK_PIXELS  100000
+#define MIN_NS        200000000   /* keep timing each case this long */
+
+/* What musicwidget.c did before tint.h: greyscale, via doubles,
+ * ignoring premultiplication. */
+static void old_loop(uint32_t *px, size_t n, const TintMap *t)
+{
+    (void)t;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t p    = px[i];
+        uint8_t  a    = (p >> 24) & 0xff;
+        uint8_t  r    = (p >> 16) & 0xff;
+        uint8_t  g    = (p >>  8) & 0xff;
+        uint8_t  b    = (p      ) & 0xff;
+        uint8_t  grey = (uint8_t)(0.299*r + 0.587*g + 0.114*b);
+        px[i] = ((uint32_t)a << 24) | ((uint32_t)grey << 16) |
+                ((uint32_t)grey << 8) | (uint32_t)grey;
+    }
+}
+
+typedef void (*Kernel)(uint32_t *, size_t, const TintMap *);
+
+static const struct {
+    const char *name;
+    Kernel      fn;
+    int         exact;   /* must match tint_scalar bit for bit */
+} kernels[] = {
+    { "old loop", old_loop,    0 },
+    { "scalar",   tint_scalar, 1 },
+#if defined(__x86_64__) || defined(__i386__)
+    { "sse2",     tint_sse2,   1 },
+    { "avx2",     tint_avx2,   1 },
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    { "neon",     tint_neon,   1 },
+#endif
+};
+#define KERNELS  (sizeof(kernels) / sizeof(kernels[0]))
+
+static const struct {
+    const char *name;
+    TintMap     map;
+} maps[] = {
+    { "greyscale (default)", { { 0, 0, 0 },    { 255, 255, 255 } } },
+    { "grey, lifted",        { { 30, 30, 30 }, { 220, 220, 220 } } },
+    { "duotone",             { { 20, 10, 60 }, { 255, 200, 120 } } },
+};
+#define MAPS  (sizeof(maps) / sizeof(maps[0]))
+
+static int supported(const char *name)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (strcmp(name, "sse2") == 0) return __builtin_cpu_supports("sse2");
+    if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+#endif
+    (void)name;
+    return 1;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Random premultiplied pixels: no channel above alpha. */
+static void fill(uint32_t *px, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        uint32_t a = rand() & 0xff;
+        uint32_t r = a ? rand() % (a + 1) : 0;
+        uint32_t g = a ? rand() % (a + 1) : 0;
+        uint32_t b = a ? rand() % (a + 1) : 0;
+        px[i] = a << 24 | r << 16 | g << 8 | b;
+    }
+}
+
+static int check(void)
+{
+    uint32_t *src = malloc(CHECK_PIXELS * sizeof(*src));
+    uint32_t *ref = malloc(CHECK_PIXELS * sizeof(*ref));
+    uint32_t *out = malloc(CHECK_PIXELS * sizeof(*out));
+    int bad = 0;
+    fill(src, CHECK_PIXELS);
+
+    for (size_t m = 0; m < MAPS; m++) {
+        memcpy(ref, src, CHECK_PIXELS * sizeof(*ref));
+        tint_scalar(ref, CHECK_PIXELS, &maps[m].map);
+        for (size_t k = 0; k < KERNELS; k++) {
+            if (!kernels[k].exact || !supported(kernels[k].name)) continue;
+            memcpy(out, src, CHECK_PIXELS * sizeof(*out));
+            kernels[k].fn(out, CHECK_PIXELS, &maps[m].map);
+            if (memcmp(out, ref, CHECK_PIXELS * sizeof(*out)) != 0) {
+                printf("MISMATCH: %s, %s map\n", kernels[k].name,
+                       maps[m].name);
+                bad = 1;
+            }
+        }
+    }
+    free(src);
+    free(ref);
+    free(out);
+    return bad;
+}
+
+int main(void)
+{
+    static const int sides[] = { 72, 144, 512 };
+    srand(1);
+    if (check()) return 1;
+
+    tint_init();
+    for (size_t k = 0; k < KERNELS; k++)
+        if (kernels[k].fn == tint_row)
+            printf("all kernels match scalar; the widget would use %s\n\n",
+                   kernels[k].name);
+
+    for (size_t m = 0; m < MAPS; m++) {
+        printf("%s map\n%-10s", maps[m].name, "");
+        for (size_t k = 0; k < KERNELS; k++)
+            if (supported(kernels[k].name))
+                printf("%10s", kernels[k].name);
+        printf("\n");
+
+        for (size_t s = 0; s < sizeof(sides) / sizeof(sides[0]); s++) {
+            size_t    n   = (size_t)sides[s] * sides[s];
+            uint32_t *src = malloc(n * sizeof(*src));
+            uint32_t *px  = malloc(n * sizeof(*px));
+            fill(src, n);
+            printf("%4dx%-5d", sides[s], sides[s]);
+
+            for (size_t k = 0; k < KERNELS; k++) {
+                if (!supported(kernels[k].name)) continue;
+                /* Time the tint alone; the copy just resets the input. */
+                double spent = 0;
+                long   runs  = 0;
+                while (spent < MIN_NS) {
+                    memcpy(px, src, n * sizeof(*px));
+                    double t0 = now_ns();
+                    kernels[k].fn(px, n, &maps[m].map);
+                    spent += now_ns() - t0;
+                    runs++;
+                }
+                printf("%8.1fus", spent / runs / 1000);
+            }
+            printf("\n");
+            free(src);
+            free(px);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -1,6 +1,6 @@
 /*
  * musicwidget.c
- * LightArch music widget — Cairo + Wayland + wlr-layer-shell
+ * LightArch music widget — Cairo + Wayland + wlr-layer-shell + MPRIS
  *
  * Build:
  *   wayland-scanner client-header \
@@ -19,13 +19,21 @@
  *   gcc -o musicwidget musicwidget.c \
  *     wlr-layer-shell-unstable-v1-client-protocol.c \
  *     xdg-shell-client-protocol.c \
- *     $(pkg-config --cflags --libs wayland-client cairo) \
- *     -lwayland-cursor -lm -lrt
+ *     $(pkg-config --cflags --libs wayland-client cairo libsystemd \
+ *                                  libjpeg libwebp) \
+ *     -lwayland-cursor -lm -lrt -pthread
+ *
+ *   Without libsystemd, add -DNO_SDBUS and drop it from pkg-config;
+ *   the widget then follows the player through a playerctl coprocess.
+ *   Likewise -DNO_WEBP for libwebp, leaving WebP covers to ffmpeg.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <math.h>
 #include <unistd.h>
 #include <time.h>
@@ -34,13 +42,34 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <spawn.h>
 
 #include <wayland-client.h>
 #include <wayland-cursor.h>
 #include <cairo/cairo.h>
+#include <jpeglib.h>
+#include <setjmp.h>
+#ifndef NO_WEBP
+#include <webp/decode.h>
+#endif
+#ifndef NO_SDBUS
+#include <systemd/sd-bus.h>
+#endif
 
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
+#include "tint.h"
 
 /* ── Dimensions ──────────────────────────────────────────────────────── */
 #define WIDTH        320
@@ -49,12 +78,28 @@
 #define ART_SIZE     72
 #define ART_RADIUS   10.0
 #define CARD_RADIUS  18.0
-#define POLL_MS      100   /* poll playerctl every 100ms */
+#define SYNC_MS      5000  /* re-ask the player for its position */
 
 #define BTN_CX  (WIDTH  - MARGIN - 14)
 #define BTN_CY  (MARGIN + 14)
 #define BTN_R   14
 
+/* ── Player ──────────────────────────────────────────────────────────── */
+#define MPRIS_PREFIX "org.mpris.MediaPlayer2."
+#define MPRIS_PATH   "/org/mpris/MediaPlayer2"
+#define MPRIS_PLAYER "org.mpris.MediaPlayer2.Player"
+#define MPRIS_TRACKS "org.mpris.MediaPlayer2.TrackList"
+#define PREFETCH_TRACKS  2   /* upcoming covers to decode ahead of time */
+#define MAX_PLAYERS      8   /* MPRIS players tracked at once */
+
+/* Which player the card follows when several are around, as a comma
+ * list of short bus names (the part after MPRIS_PREFIX). A playing
+ * player always beats a paused one; between playing ones this list
+ * decides, then whichever started last. Among paused ones the most
+ * recently active wins, then this list. Unlisted players rank after
+ * listed ones. */
+#define PLAYER_PRIORITY  "kew"
+
 /* ── Colours ─────────────────────────────────────────────────────────── */
 #define COL_BG      0.059, 0.059, 0.059, 1.0
 #define COL_BORDER  0.165, 0.165, 0.165, 1.0
@@ -67,6 +112,10 @@
 #define COL_BTN     1.0,   1.0,   1.0,   1.0
 #define COL_BTN_FG  0.059, 0.059, 0.059, 1.0
 #define COL_NOTE    0.267, 0.267, 0.267, 1.0
+/* Album art is mapped onto a shadow → highlight ramp (8-bit RGB).
+ * Black → white is plain greyscale; anything else is a duotone. */
+#define COL_ART_SHADOW     0,   0,   0
+#define COL_ART_HIGHLIGHT  255, 255, 255
 #define FONT_FACE   "Lettera Mono LL"
 
 /* ── Wayland globals ─────────────────────────────────────────────────── */
@@ -78,7 +127,6 @@ static struct wl_seat                 *seat;
 
 static struct wl_surface              *surface;
 static struct zwlr_layer_surface_v1   *layer_surface;
-static struct wl_buffer               *buffer;
 static struct wl_pointer              *pointer;
 
 static struct wl_cursor_theme         *cursor_theme;
@@ -86,8 +134,6 @@ static struct wl_cursor               *cursor_pointer;
 static struct wl_cursor               *cursor_default;
 static struct wl_surface              *cursor_surface;
 
-static void  *shm_data   = NULL;
-static int    shm_fd      = -1;
 static int    configured  = 0;
 static int    running     = 1;
 
@@ -97,189 +143,2717 @@ typedef struct {
     char   artist[256];
     char   album[256];
     char   art_url[512];
-    double position;
-    double length;
-    int    playing;
+    char   track_url[512];   /* xesam:url — the file being played */
+    char   track_id[256];
+    double   position;      /* as last reported by the player */
+    uint64_t position_ts;   /* CLOCK_MONOTONIC µs of that report */
+    double   rate;
+    double   volume;        /* 0..1, if has_volume */
+    int      has_volume;
+    double   length;
+    int      playing;
 } PlayerState;
 
-static PlayerState state;
+static PlayerState state;
+static int         state_dirty = 0;   /* set by signal handlers */
+static int         art_recheck = 1;   /* metadata re-sent; stat the art */
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Where playback is now. Players only tell us the position when it
+ * jumps, so between reports we run the clock forward ourselves.
+ */
+static double state_position(const PlayerState *ps)
+{
+    double pos = ps->position;
+    if (ps->playing)
+        pos += ps->rate * (now_us() - ps->position_ts) / 1000000.0;
+    if (ps->length > 0 && pos > ps->length) pos = ps->length;
+    return pos < 0 ? 0 : pos;
+}
+
+static void set_position(PlayerState *ps, double pos)
+{
+    ps->position    = pos;
+    ps->position_ts = now_us();
+}
+
+/* ── Subprocesses ────────────────────────────────────────────────────── */
+
+/*
+ * Everything the widget runs goes through spawn(): posix_spawnp with
+ * an argv, so no shell and nothing in a file name gets interpreted;
+ * stdin and stderr on /dev/null; stdout on a pipe if the caller
+ * wants it, /dev/null otherwise; and the signal mask main() set up
+ * cleared again. glibc spawns with CLONE_VFORK, so unlike fork() it
+ * doesn't copy our page tables — shm buffers, cursor theme, covers
+ * and all. Every fd we open ourselves is close-on-exec; only the
+ * three standard ones reach the child.
+ */
+#define SPAWN_OUT_MAX  (32 << 20)   /* cap on captured output */
+
+static pid_t spawn(char *const argv[], int *out)
+{
+    int fds[2] = { -1, -1 };
+    if (out && pipe2(fds, O_CLOEXEC) < 0) return -1;
+
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t          attr;
+    sigset_t                   none;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, STDIN_FILENO, "/dev/null",
+                                     O_RDONLY, 0);
+    if (out)
+        posix_spawn_file_actions_adddup2(&fa, fds[1], STDOUT_FILENO);
+    else
+        posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null",
+                                         O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null",
+                                     O_WRONLY, 0);
+    posix_spawnattr_init(&attr);
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], &fa, &attr, argv, environ) != 0)
+        pid = -1;
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+
+    if (out) {
+        close(fds[1]);
+        if (pid < 0) close(fds[0]);
+        else *out = fds[0];
+    }
+    return pid;
+}
+
+/*
+ * Run argv to completion and collect what it prints, giving up (and
+ * killing it) after timeout_ms. Returns the exit status, or -1 if it
+ * couldn't run or didn't finish; *buf is malloc()ed either way.
+ */
+static int spawn_capture(char *const argv[], int timeout_ms,
+                         unsigned char **buf, size_t *len)
+{
+    *buf = NULL;
+    *len = 0;
+    int fd;
+    pid_t pid = spawn(argv, &fd);
+    if (pid < 0) return -1;
+
+    uint64_t deadline = now_us() + timeout_ms * 1000ULL;
+    size_t   cap      = 0;
+    int      ok       = 1;
+    for (;;) {
+        uint64_t now = now_us();
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (now >= deadline ||
+            poll(&pfd, 1, (int)((deadline - now + 999) / 1000)) == 0) {
+            ok = 0;                          /* timed out */
+            break;
+        }
+        if (*len == cap) {
+            size_t want = cap ? cap * 2 : 64 << 10;
+            unsigned char *grown = want <= SPAWN_OUT_MAX
+                                 ? realloc(*buf, want) : NULL;
+            if (!grown) { ok = 0; break; }
+            *buf = grown;
+            cap  = want;
+        }
+        ssize_t n = read(fd, *buf + *len, cap - *len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        *len += n;
+    }
+    close(fd);
+
+    int status;
+    if (!ok) kill(pid, SIGKILL);
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (!ok || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+/* ── MPRIS ───────────────────────────────────────────────────────────── */
+
+#ifndef NO_SDBUS
+
+static sd_bus *bus;
+
+/*
+ * Read the value of a variant holding a string (or object path) into
+ * dst. Whatever else the player put there is skipped, so the message
+ * cursor always ends up past the variant.
+ */
+static void variant_string(sd_bus_message *m, char *dst, size_t n)
+{
+    const char *sig = NULL;
+    const char *v   = NULL;
+    if (sd_bus_message_peek_type(m, NULL, &sig) < 0 || !sig) return;
+
+    if ((strcmp(sig, "s") == 0 || strcmp(sig, "o") == 0) &&
+        sd_bus_message_enter_container(m, 'v', sig) > 0) {
+        if (sd_bus_message_read_basic(m, sig[0], &v) > 0 && v)
+            snprintf(dst, n, "%s", v);
+        sd_bus_message_exit_container(m);
+    } else if (strcmp(sig, "as") == 0 &&
+               sd_bus_message_enter_container(m, 'v', sig) > 0) {
+        /* xesam:artist is a list — join it the way playerctl does. */
+        size_t len = 0;
+        dst[0] = '\0';
+        sd_bus_message_enter_container(m, 'a', "s");
+        while (sd_bus_message_read_basic(m, 's', &v) > 0) {
+            len += snprintf(dst + len, len < n ? n - len : 0,
+                            "%s%s", len ? ", " : "", v);
+            if (len >= n) len = n - 1;
+        }
+        sd_bus_message_exit_container(m);
+        sd_bus_message_exit_container(m);
+    } else {
+        sd_bus_message_skip(m, "v");
+    }
+}
+
+/* Same again for numbers. Players disagree on the integer width of
+ * mpris:length, so take anything numeric. */
+static void variant_number(sd_bus_message *m, double *out)
+{
+    const char *sig = NULL;
+    if (sd_bus_message_peek_type(m, NULL, &sig) < 0 || !sig) return;
+    if (strlen(sig) != 1 || !strchr("xtiud", sig[0]) ||
+        sd_bus_message_enter_container(m, 'v', sig) <= 0) {
+        sd_bus_message_skip(m, "v");
+        return;
+    }
+    union { int64_t x; uint64_t t; int32_t i; uint32_t u; double d; } v;
+    if (sd_bus_message_read_basic(m, sig[0], &v) > 0) {
+        switch (sig[0]) {
+        case 'x': *out = (double)v.x; break;
+        case 't': *out = (double)v.t; break;
+        case 'i': *out = (double)v.i; break;
+        case 'u': *out = (double)v.u; break;
+        case 'd': *out = v.d;         break;
+        }
+    }
+    sd_bus_message_exit_container(m);
+}
+
+static void parse_metadata(sd_bus_message *m, PlayerState *ps)
+{
+    const char *sig = NULL;
+    if (sd_bus_message_peek_type(m, NULL, &sig) < 0 || !sig ||
+        strcmp(sig, "a{sv}") != 0 ||
+        sd_bus_message_enter_container(m, 'v', sig) <= 0) {
+        sd_bus_message_skip(m, "v");
+        return;
+    }
+
+    /* Metadata always arrives whole, so anything missing is gone. */
+    art_recheck = 1;
+    ps->title[0] = ps->artist[0] = ps->album[0] = ps->art_url[0] = '\0';
+    ps->track_url[0] = ps->track_id[0] = '\0';
+    ps->length = 0;
+
+    sd_bus_message_enter_container(m, 'a', "{sv}");
+    while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+        const char *key = "";
+        sd_bus_message_read_basic(m, 's', &key);
+        if      (strcmp(key, "xesam:title")  == 0)
+            variant_string(m, ps->title,   sizeof(ps->title));
+        else if (strcmp(key, "xesam:artist") == 0)
+            variant_string(m, ps->artist,  sizeof(ps->artist));
+        else if (strcmp(key, "xesam:album")  == 0)
+            variant_string(m, ps->album,   sizeof(ps->album));
+        else if (strcmp(key, "mpris:artUrl") == 0)
+            variant_string(m, ps->art_url, sizeof(ps->art_url));
+        else if (strcmp(key, "mpris:trackid") == 0)
+            variant_string(m, ps->track_id, sizeof(ps->track_id));
+        else if (strcmp(key, "xesam:url") == 0)
+            variant_string(m, ps->track_url, sizeof(ps->track_url));
+        else if (strcmp(key, "mpris:length") == 0) {
+            variant_number(m, &ps->length);
+            ps->length /= 1000000.0;
+        } else
+            sd_bus_message_skip(m, "v");
+        sd_bus_message_exit_container(m);
+    }
+    sd_bus_message_exit_container(m);
+    sd_bus_message_exit_container(m);
+}
+
+/*
+ * Walk an a{sv} of org.mpris.MediaPlayer2.Player properties, as found
+ * in a GetAll reply, and fold the ones we draw into ps. Returns
+ * whether PlaybackStatus was among them.
+ */
+static int parse_properties(sd_bus_message *m, PlayerState *ps)
+{
+    int got_status = 0;
+    if (sd_bus_message_enter_container(m, 'a', "{sv}") <= 0) return 0;
+    while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+        const char *key = "";
+        sd_bus_message_read_basic(m, 's', &key);
+        if (strcmp(key, "Metadata") == 0) {
+            parse_metadata(m, ps);
+        } else if (strcmp(key, "PlaybackStatus") == 0) {
+            char status[32] = {0};
+            variant_string(m, status, sizeof(status));
+            /* Freeze or restart the clock where it stands; a stopped
+             * player has nowhere to stand but the start. */
+            set_position(ps, strcmp(status, "Stopped") == 0
+                             ? 0 : state_position(ps));
+            ps->playing = (strcmp(status, "Playing") == 0);
+            got_status = 1;
+        } else if (strcmp(key, "Rate") == 0) {
+            double rate = ps->rate;
+            variant_number(m, &rate);
+            set_position(ps, state_position(ps));
+            ps->rate = rate;
+        } else if (strcmp(key, "Volume") == 0) {
+            ps->has_volume = 1;
+            variant_number(m, &ps->volume);
+        } else if (strcmp(key, "Position") == 0) {
+            double pos = 0;
+            variant_number(m, &pos);
+            set_position(ps, pos / 1000000.0);
+        } else {
+            sd_bus_message_skip(m, "v");
+        }
+        sd_bus_message_exit_container(m);
+    }
+    sd_bus_message_exit_container(m);
+    return got_status;
+}
+
+/*
+ * Players. Every org.mpris.MediaPlayer2.* name on the bus gets a slot
+ * and its own PlayerState, kept current by its signals; NameOwnerChanged
+ * tells us when one comes or goes, so an idle player costs nothing.
+ * The card follows one of them at a time, chosen by player_select().
+ * That one's state lives in the global `state`, where the drawing
+ * code reads it — ps_of() knows which is which.
+ *
+ * Async replies carry the slot's id rather than a pointer, since the
+ * player may have left (and its slot been reused) by the time they
+ * arrive.
+ */
+typedef struct {
+    char        name[128];         /* well-known: MPRIS_PREFIX + "…" */
+    char        owner[64];         /* unique name behind it */
+    unsigned    id;                /* 0 = free slot */
+    PlayerState ps;                /* unless it's the current one */
+    uint64_t    active;            /* now_us() it last did something */
+    unsigned    status_seen;       /* bumped per PlaybackStatus */
+    unsigned    sent_seen;         /* status_seen at our last command */
+    int         tracklist_missing; /* doesn't implement TrackList */
+    char        tracklist_for[256];/* track id we last looked around */
+} Player;
+
+static Player   players[MAX_PLAYERS];
+static Player  *current = NULL;
+static unsigned player_ids = 0;
+
+static PlayerState *ps_of(Player *p)
+{
+    return p == current ? &state : &p->ps;
+}
+
+static Player *player_by_id(void *data)
+{
+    unsigned id = (unsigned)(uintptr_t)data;
+    for (int i = 0; i < MAX_PLAYERS; i++)
+        if (players[i].id && players[i].id == id)
+            return &players[i];
+    return NULL;
+}
+
+/* One client can own several MPRIS names (a browser with a name per
+ * tab, say), and its signals are addressed from its unique name, so
+ * this walks them: pass the last one found, or NULL to start. */
+static Player *player_by_owner(const char *owner, Player *after)
+{
+    for (int i = after ? after - players + 1 : 0;
+         owner && i < MAX_PLAYERS; i++)
+        if (players[i].id && strcmp(players[i].owner, owner) == 0)
+            return &players[i];
+    return NULL;
+}
+
+static Player *player_by_name(const char *name)
+{
+    for (int i = 0; i < MAX_PLAYERS; i++)
+        if (players[i].id && strcmp(players[i].name, name) == 0)
+            return &players[i];
+    return NULL;
+}
+
+#define ID(p)  ((void *)(uintptr_t)(p)->id)
+
+/* Position in PLAYER_PRIORITY of the player's short name (the bus
+ * name's next component, so "firefox" covers firefox.instance123);
+ * unlisted players come after all the listed ones. */
+static int player_rank(const Player *p)
+{
+    const char *short_name = p->name + strlen(MPRIS_PREFIX);
+    size_t len = strcspn(short_name, ".");
+    const char *list = PLAYER_PRIORITY;
+    for (int rank = 0; *list; rank++) {
+        size_t n = strcspn(list, ",");
+        if (n == len && strncmp(list, short_name, n) == 0)
+            return rank;
+        list += n + (list[n] == ',');
+    }
+    return INT_MAX;
+}
+
+/* Does a beat b? See PLAYER_PRIORITY. */
+static int player_beats(const Player *a, const Player *b)
+{
+    const PlayerState *as = a == current ? &state : &a->ps;
+    const PlayerState *bs = b == current ? &state : &b->ps;
+    if (as->playing != bs->playing) return as->playing;
+
+    int ra = player_rank(a), rb = player_rank(b);
+    if (as->playing && ra != rb) return ra < rb;
+    if (a->active != b->active) return a->active > b->active;
+    return ra < rb;
+}
+
+static void tracklist_prefetch(void);
+
+/* Point the card at whichever player deserves it now. */
+static void player_select(void)
+{
+    Player *best = NULL;
+    for (int i = 0; i < MAX_PLAYERS; i++)
+        if (players[i].id && (!best || player_beats(&players[i], best)))
+            best = &players[i];
+    if (best == current) return;
+
+    if (current) current->ps = state;
+    current = best;
+    if (current) {
+        state = current->ps;
+    } else {
+        memset(&state, 0, sizeof(state));
+        state.rate = 1.0;
+    }
+    art_recheck = 1;
+    state_dirty = 1;
+    tracklist_prefetch();
+}
+
+/*
+ * TrackList prefetch. Players that publish their queue let us look
+ * up the next few tracks' art and decode it before it's needed, so
+ * the cover changes with the title instead of after it. Both calls
+ * are async; the replies arrive through the normal bus dispatch.
+ * Only the player on the card gets asked.
+ */
+static void art_prefetch(char (*urls)[512], const int *track, int n);
+
+static int on_tracks_metadata(sd_bus_message *m, void *data,
+                              sd_bus_error *err)
+{
+    char urls[PREFETCH_TRACKS][512] = {{0}};
+    int  track[PREFETCH_TRACKS] = {0};
+    int  n = 0;
+
+    if (player_by_id(data) != current ||
+        sd_bus_message_is_method_error(m, NULL) ||
+        sd_bus_message_enter_container(m, 'a', "a{sv}") <= 0)
+        return 0;
+    while (n < PREFETCH_TRACKS &&
+           sd_bus_message_enter_container(m, 'a', "{sv}") > 0) {
+        char file[512] = {0};
+        while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+            const char *key = "";
+            sd_bus_message_read_basic(m, 's', &key);
+            if (strcmp(key, "mpris:artUrl") == 0)
+                variant_string(m, urls[n], sizeof(urls[n]));
+            else if (strcmp(key, "xesam:url") == 0)
+                variant_string(m, file, sizeof(file));
+            else
+                sd_bus_message_skip(m, "v");
+            sd_bus_message_exit_container(m);
+        }
+        sd_bus_message_exit_container(m);
+        if (!urls[n][0]) {   /* same fallback as redraw() */
+            memcpy(urls[n], file, sizeof(file));
+            track[n] = 1;
+        }
+        n++;
+    }
+    art_prefetch(urls, track, n);
+    return 0;
+}
+
+static int on_tracks(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    Player *p = player_by_id(data);
+    if (!p || p != current) return 0;
+    if (sd_bus_message_is_method_error(m, NULL)) {
+        p->tracklist_missing = 1;
+        return 0;
+    }
+    if (sd_bus_message_enter_container(m, 'v', "ao") <= 0 ||
+        sd_bus_message_enter_container(m, 'a', "o") <= 0)
+        return 0;
+
+    /* The ids point into m, which outlives the call we build. */
+    const char *ids[PREFETCH_TRACKS];
+    const char *id;
+    int n = 0, found = 0;
+    while (n < PREFETCH_TRACKS &&
+           sd_bus_message_read_basic(m, 'o', &id) > 0) {
+        if (found)
+            ids[n++] = id;
+        else if (strcmp(id, state.track_id) == 0)
+            found = 1;
+    }
+    if (!n) return 0;
+
+    sd_bus_message *call = NULL;
+    if (sd_bus_message_new_method_call(bus, &call, p->owner, MPRIS_PATH,
+            MPRIS_TRACKS, "GetTracksMetadata") < 0)
+        return 0;
+    sd_bus_message_open_container(call, 'a', "o");
+    for (int i = 0; i < n; i++)
+        sd_bus_message_append_basic(call, 'o', ids[i]);
+    sd_bus_message_close_container(call);
+    sd_bus_call_async(bus, NULL, call, on_tracks_metadata, ID(p), 0);
+    sd_bus_message_unref(call);
+    return 0;
+}
+
+/* Call whenever the track may have changed. */
+static void tracklist_prefetch(void)
+{
+    Player *p = current;
+    if (!p || p->tracklist_missing || !state.track_id[0] ||
+        strcmp(state.track_id, p->tracklist_for) == 0)
+        return;
+    snprintf(p->tracklist_for, sizeof(p->tracklist_for), "%s",
+             state.track_id);
+    sd_bus_call_method_async(bus, NULL, p->owner, MPRIS_PATH,
+        "org.freedesktop.DBus.Properties", "Get",
+        on_tracks, ID(p), "ss", MPRIS_TRACKS, "Tracks");
+}
+
+/*
+ * One Properties.GetAll round-trip fetches everything we draw, for a
+ * player that just turned up or invalidated something.
+ */
+static int on_getall(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    Player *p = player_by_id(data);
+    if (!p || sd_bus_message_is_method_error(m, NULL)) return 0;
+
+    PlayerState *ps = ps_of(p);
+    int was_playing = ps->playing;
+    memset(ps, 0, sizeof(*ps));
+    ps->rate = 1.0;
+    if (parse_properties(m, ps)) p->status_seen++;
+    if (ps->playing != was_playing) p->active = now_us();
+    if (p == current) {
+        art_recheck = 1;
+        state_dirty = 1;
+    }
+    player_select();
+    tracklist_prefetch();
+    return 0;
+}
+
+static void player_fetch(Player *p)
+{
+    sd_bus_call_method_async(bus, NULL, p->owner, MPRIS_PATH,
+        "org.freedesktop.DBus.Properties", "GetAll",
+        on_getall, ID(p), "s", MPRIS_PLAYER);
+}
+
+/*
+ * Position is the one property players never signal. We extrapolate
+ * it instead, and only come back here to correct for drift.
+ */
+static int on_position(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    Player *p = player_by_id(data);
+    if (!p || sd_bus_message_is_method_error(m, NULL)) return 0;
+    PlayerState *ps = ps_of(p);
+    double pos = 0;
+    variant_number(m, &pos);
+    set_position(ps, pos / 1000000.0);
+    if (p == current) state_dirty = 1;
+    return 0;
+}
+
+static void player_resync(void)
+{
+    if (!current) return;
+    sd_bus_call_method_async(bus, NULL, current->owner, MPRIS_PATH,
+        "org.freedesktop.DBus.Properties", "Get",
+        on_position, ID(current), "ss", MPRIS_PLAYER, "Position");
+}
+
+static int on_status(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    Player *p = player_by_id(data);
+    if (!p || sd_bus_message_is_method_error(m, NULL)) return 0;
+    PlayerState *ps = ps_of(p);
+    char status[32] = {0};
+    variant_string(m, status, sizeof(status));
+    set_position(ps, strcmp(status, "Stopped") == 0
+                     ? 0 : state_position(ps));
+    if (ps->playing != (strcmp(status, "Playing") == 0)) {
+        ps->playing = !ps->playing;
+        p->active   = now_us();
+    }
+    if (p == current) state_dirty = 1;
+    player_select();
+    return 0;
+}
+
+/*
+ * Controls go out as async method calls, so a slow player never
+ * holds up the UI. The click has already flipped the icon; the
+ * player's own PlaybackStatus signal settles it. If the call fails,
+ * or succeeds without the player having said anything, we ask.
+ */
+static int on_command(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    Player *p = player_by_id(data);
+    if (p && (sd_bus_message_is_method_error(m, NULL) ||
+              p->status_seen == p->sent_seen))
+        sd_bus_call_method_async(bus, NULL, p->owner, MPRIS_PATH,
+            "org.freedesktop.DBus.Properties", "Get",
+            on_status, ID(p), "ss", MPRIS_PLAYER, "PlaybackStatus");
+    return 0;
+}
+
+static int player_present(void)
+{
+    return current != NULL;
+}
+
+static void player_send(const char *method)
+{
+    if (!current) return;
+    current->sent_seen = current->status_seen;
+    current->active    = now_us();   /* keep the card on what we poke */
+    sd_bus_call_method_async(bus, NULL, current->owner, MPRIS_PATH,
+        MPRIS_PLAYER, method, on_command, ID(current), NULL);
+}
+
+/*
+ * Seeking. A drag produces a target per motion event, far more than
+ * any player wants to hear, so only one SetPosition is in flight at a
+ * time; whatever target came in meanwhile goes out when it returns.
+ */
+static struct {
+    int    busy;      /* a SetPosition awaits its reply */
+    int    pending;   /* and the target has moved since */
+    double target;    /* seconds */
+} seek;
+
+static void seek_send(void);
+
+static int on_seek(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    seek.busy = 0;
+    if (seek.pending) seek_send();
+    return 0;
+}
+
+static void seek_send(void)
+{
+    seek.pending = 0;
+    /* SetPosition names the track, so a seek that arrives late can't
+     * land in the next one. No track id, no seeking. */
+    if (!current || !state.track_id[0]) return;
+    if (sd_bus_call_method_async(bus, NULL, current->owner, MPRIS_PATH,
+            MPRIS_PLAYER, "SetPosition", on_seek, ID(current), "ox",
+            state.track_id, (int64_t)(seek.target * 1000000)) >= 0)
+        seek.busy = 1;
+}
+
+static void player_seek(double pos)
+{
+    seek.target = pos;
+    if (seek.busy)
+        seek.pending = 1;
+    else
+        seek_send();
+}
+
+/* Volume works the same way: nudges pile up in volume.delta while a
+ * Set is out, then go as one. Players that never told us their Volume
+ * presumably don't have one. */
+static struct {
+    int    busy;
+    double delta;
+} volume;
+
+static void volume_send(void);
+
+static int on_volume_get(sd_bus_message *m, void *data,
+                         sd_bus_error *err)
+{
+    Player *p = player_by_id(data);
+    if (!p || sd_bus_message_is_method_error(m, NULL)) return 0;
+    variant_number(m, &ps_of(p)->volume);
+    return 0;
+}
+
+/* A refused Set (a read-only Volume, say) leaves our optimistic value
+ * wrong, and the next nudge would build on it: drop what's pending
+ * and ask the player what it really has. */
+static int on_volume(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    Player *p = player_by_id(data);
+    volume.busy = 0;
+    if (sd_bus_message_is_method_error(m, NULL)) {
+        volume.delta = 0;
+        if (p)
+            sd_bus_call_method_async(bus, NULL, p->owner, MPRIS_PATH,
+                "org.freedesktop.DBus.Properties", "Get",
+                on_volume_get, ID(p), "ss", MPRIS_PLAYER, "Volume");
+        return 0;
+    }
+    if (volume.delta != 0) volume_send();
+    return 0;
+}
+
+static void volume_send(void)
+{
+    double v = fmin(fmax(state.volume + volume.delta, 0), 1);
+    volume.delta = 0;
+    if (!current || !state.has_volume || v == state.volume) return;
+    if (sd_bus_call_method_async(bus, NULL, current->owner, MPRIS_PATH,
+            "org.freedesktop.DBus.Properties", "Set", on_volume,
+            ID(current), "ssv", MPRIS_PLAYER, "Volume", "d", v) >= 0) {
+        state.volume = v;   /* so the next batch adds to this one */
+        volume.busy  = 1;
+    }
+}
+
+static void player_volume(double delta)
+{
+    volume.delta += delta;
+    if (!volume.busy) volume_send();
+}
+
+static void properties_changed(Player *p, sd_bus_message *m)
+{
+    PlayerState *ps = ps_of(p);
+    int was_playing = ps->playing;
+    char was_track[256];
+    memcpy(was_track, ps->track_id, sizeof(was_track));
+    if (parse_properties(m, ps)) p->status_seen++;
+
+    /* A new track starts at 0 unless a Seeked says otherwise. */
+    int new_track = strcmp(ps->track_id, was_track) != 0;
+    if (new_track)
+        set_position(ps, 0);
+
+    /* Playing, pausing or changing track counts as activity. Merely
+     * turning up on the bus doesn't. */
+    if (ps->playing != was_playing || new_track)
+        p->active = now_us();
+
+    /* Players are allowed to merely invalidate a property instead
+     * of sending its new value. Go and get it if they do. */
+    int refetch = 0;
+    const char *name;
+    if (sd_bus_message_enter_container(m, 'a', "s") > 0) {
+        while (sd_bus_message_read_basic(m, 's', &name) > 0)
+            if (strcmp(name, "Metadata") == 0 ||
+                strcmp(name, "PlaybackStatus") == 0)
+                refetch = 1;
+        sd_bus_message_exit_container(m);
+    }
+    if (refetch)
+        player_fetch(p);
+
+    player_select();
+    if (p == current) {
+        /* Status flips and new tracks are worth a resync. */
+        if (!refetch && (ps->playing != was_playing || new_track))
+            player_resync();
+        tracklist_prefetch();
+        state_dirty = 1;
+    }
+}
+
+static int on_properties_changed(sd_bus_message *m, void *data,
+                                 sd_bus_error *err)
+{
+    const char *sender = sd_bus_message_get_sender(m);
+    const char *iface  = NULL;
+    if (sd_bus_message_read_basic(m, 's', &iface) <= 0 ||
+        strcmp(iface, MPRIS_PLAYER) != 0)
+        return 0;
+
+    /* Every name the sender owns hears it, each reading from just
+     * past the interface. */
+    for (Player *p = NULL; (p = player_by_owner(sender, p)); ) {
+        if (sd_bus_message_rewind(m, 1) < 0 ||
+            sd_bus_message_skip(m, "s") < 0)
+            break;
+        properties_changed(p, m);
+    }
+    return 0;
+}
+
+static int on_seeked(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    const char *sender = sd_bus_message_get_sender(m);
+    int64_t pos;
+    if (sd_bus_message_read_basic(m, 'x', &pos) <= 0)
+        return 0;
+    for (Player *p = NULL; (p = player_by_owner(sender, p)); ) {
+        set_position(ps_of(p), pos / 1000000.0);
+        if (p == current) state_dirty = 1;
+    }
+    return 0;
+}
+
+/* A player came, went or restarted under the same name. */
+static void player_named(const char *name, const char *owner)
+{
+    if (strncmp(name, MPRIS_PREFIX, strlen(MPRIS_PREFIX)) != 0)
+        return;
+    Player *p = player_by_name(name);
+
+    if (!owner || !owner[0]) {
+        if (!p) return;
+        if (p == current) {
+            /* Stop it being mirrored into state before it goes. */
+            current = NULL;
+            memset(&state, 0, sizeof(state));
+            state.rate  = 1.0;
+            art_recheck = 1;
+            state_dirty = 1;
+        }
+        memset(p, 0, sizeof(*p));
+        player_select();
+        return;
+    }
+
+    if (!p) {
+        for (int i = 0; i < MAX_PLAYERS && !p; i++)
+            if (!players[i].id) p = &players[i];
+        if (!p) return;                 /* full; ignore the newcomer */
+        snprintf(p->name, sizeof(p->name), "%s", name);
+        p->ps.rate = 1.0;
+    }
+    p->id = ++player_ids;               /* drop replies for the old one */
+    snprintf(p->owner, sizeof(p->owner), "%s", owner);
+    p->tracklist_missing = 0;
+    p->tracklist_for[0]  = '\0';
+    player_fetch(p);
+}
+
+static int on_name_owner_changed(sd_bus_message *m, void *data,
+                                 sd_bus_error *err)
+{
+    const char *name, *old_owner, *new_owner;
+    if (sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner) >= 0)
+        player_named(name, new_owner);
+    return 0;
+}
+
+/* Startup only: who's already here. From then on NameOwnerChanged
+ * keeps us up to date. Each name's owner is asked for separately, and
+ * asynchronously like everything else; the name rides along as the
+ * userdata. */
+static int on_name_owner(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    const char *owner = NULL;
+    if (!sd_bus_message_is_method_error(m, NULL) &&
+        sd_bus_message_read(m, "s", &owner) >= 0 &&
+        !player_by_name(data))
+        player_named(data, owner);
+    free(data);
+    return 0;
+}
+
+static int on_list_names(sd_bus_message *m, void *data, sd_bus_error *err)
+{
+    const char *name;
+    if (sd_bus_message_is_method_error(m, NULL) ||
+        sd_bus_message_enter_container(m, 'a', "s") <= 0)
+        return 0;
+    while (sd_bus_message_read_basic(m, 's', &name) > 0) {
+        if (strncmp(name, MPRIS_PREFIX, strlen(MPRIS_PREFIX)) != 0 ||
+            player_by_name(name))
+            continue;
+        char *copy = strdup(name);
+        if (copy && sd_bus_call_method_async(bus, NULL,
+                "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                "org.freedesktop.DBus", "GetNameOwner",
+                on_name_owner, copy, "s", name) < 0)
+            free(copy);
+    }
+    return 0;
+}
+
+static int player_connect(void)
+{
+    if (sd_bus_open_user(&bus) < 0) return -1;
+
+    /* Signals come from the players' unique names, so match them
+     * broadly and sort them out by sender in the handlers. */
+    sd_bus_add_match(bus, NULL,
+        "type='signal',sender='org.freedesktop.DBus',"
+        "interface='org.freedesktop.DBus',member='NameOwnerChanged',"
+        "arg0namespace='org.mpris.MediaPlayer2'",
+        on_name_owner_changed, NULL);
+    sd_bus_add_match(bus, NULL,
+        "type='signal',path='" MPRIS_PATH "',"
+        "interface='org.freedesktop.DBus.Properties',"
+        "member='PropertiesChanged',arg0='" MPRIS_PLAYER "'",
+        on_properties_changed, NULL);
+    sd_bus_add_match(bus, NULL,
+        "type='signal',path='" MPRIS_PATH "',"
+        "interface='" MPRIS_PLAYER "',member='Seeked'",
+        on_seeked, NULL);
+
+    sd_bus_call_method_async(bus, NULL, "org.freedesktop.DBus",
+        "/org/freedesktop/DBus", "org.freedesktop.DBus", "ListNames",
+        on_list_names, NULL, "");
+    return 0;
+}
+
+static void player_disconnect(void)
+{
+    sd_bus_flush_close_unref(bus);
+}
+
+static void player_reap(void) {}   /* no children here */
+
+static struct pollfd player_pollfd(void)
+{
+    return (struct pollfd){
+        .fd = sd_bus_get_fd(bus), .events = sd_bus_get_events(bus),
+    };
+}
+
+/* Milliseconds until sd-bus wants servicing regardless of the fd
+ * (method call timeouts and the like), or -1 for never. */
+static int player_timeout(uint64_t now)
+{
+    uint64_t deadline;
+    if (sd_bus_get_timeout(bus, &deadline) < 0 || deadline == UINT64_MAX)
+        return -1;
+    return deadline <= now ? 0 : (int)((deadline - now + 999) / 1000);
+}
+
+/* Run the signal handlers for whatever the player sent. */
+static void player_dispatch(short revents)
+{
+    while (sd_bus_process(bus, NULL) > 0)
+        ;
+}
+
+#else /* NO_SDBUS */
+
+/*
+ * Without a D-Bus library we leave the bus to playerctl — but to one
+ * long-lived `playerctl --follow` rather than a process per question.
+ * It prints one line per change, every field we draw separated by
+ * ASCII unit separators (which no sane tag contains), and an empty
+ * line when the player goes away. playerctl does the choosing here:
+ * the first PLAYER_PRIORITY name that's around, else any player, and
+ * it reports which one so the controls go to the same place.
+ */
+#define FOLLOW_SEP       "\x1f"
+#define FOLLOW_FORMAT    "{{status}}"                                   \
+                         FOLLOW_SEP "{{position}}"                      \
+                         FOLLOW_SEP "{{mpris:length}}"                  \
+                         FOLLOW_SEP "{{title}}"                         \
+                         FOLLOW_SEP "{{artist}}"                        \
+                         FOLLOW_SEP "{{album}}"                         \
+                         FOLLOW_SEP "{{mpris:artUrl}}"                  \
+                         FOLLOW_SEP "{{xesam:url}}"                     \
+                         FOLLOW_SEP "{{playerInstance}}"
+#define FOLLOW_FIELDS    9
+#define FOLLOW_RETRY_MS  5000   /* respawn delay if playerctl dies */
+
+static pid_t    follow_pid     = -1;
+static int      follow_fd      = -1;
+static uint64_t follow_retry   = 0;    /* now_us() deadline */
+static char     follow_buf[4096];
+static size_t   follow_len     = 0;
+static char     follow_player[64];     /* instance being followed */
+
+static void follow_start(void)
+{
+    char *argv[] = { "playerctl", "--player=" PLAYER_PRIORITY ",%any",
+                     "--follow",
+                     "metadata", "--format", FOLLOW_FORMAT, NULL };
+    follow_pid = spawn(argv, &follow_fd);
+    if (follow_pid < 0) {
+        follow_fd    = -1;
+        follow_retry = now_us() + FOLLOW_RETRY_MS * 1000ULL;
+        return;
+    }
+    follow_len = 0;
+    fcntl(follow_fd, F_SETFL, O_NONBLOCK);
+}
+
+static void follow_stop(void)
+{
+    if (follow_fd >= 0) close(follow_fd);
+    if (follow_pid > 0) {
+        kill(follow_pid, SIGTERM);
+        waitpid(follow_pid, NULL, 0);
+    }
+    follow_fd  = -1;
+    follow_pid = -1;
+}
+
+static void follow_parse(char *line)
+{
+    char *f[FOLLOW_FIELDS];
+    int   n = 0;
+    for (char *p = line; n < FOLLOW_FIELDS; ) {
+        f[n++] = p;
+        p = strchr(p, FOLLOW_SEP[0]);
+        if (!p) break;
+        *p++ = '\0';
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.rate = 1.0;
+    follow_player[0] = '\0';
+    if (n < FOLLOW_FIELDS) return;   /* player went away */
+
+    art_recheck   = 1;
+    state.playing = (strcmp(f[0], "Playing") == 0);
+    set_position(&state, atof(f[1]) / 1000000.0);
+    state.length = atof(f[2]) / 1000000.0;
+    snprintf(state.title,   sizeof(state.title),   "%s", f[3]);
+    snprintf(state.artist,  sizeof(state.artist),  "%s", f[4]);
+    snprintf(state.album,   sizeof(state.album),   "%s", f[5]);
+    snprintf(state.art_url, sizeof(state.art_url), "%s", f[6]);
+    snprintf(state.track_url, sizeof(state.track_url), "%s", f[7]);
+    snprintf(follow_player, sizeof(follow_player), "%s", f[8]);
+}
+
+static int player_connect(void)
+{
+    memset(&state, 0, sizeof(state));
+    state.rate = 1.0;
+    follow_start();
+    return 0;
+}
+
+static void player_disconnect(void)
+{
+    follow_stop();
+}
+
+/*
+ * Controls: playerctl with the method name in its own spelling
+ * (PlayPause → play-pause), spawned in the background and reaped
+ * when the main loop sees SIGCHLD. The --follow stream reports what the
+ * player did. If the command fails, restarting the stream makes
+ * playerctl print the real state over our optimistic one.
+ */
+#define CMD_MAX  4   /* controls in flight at once */
+
+static pid_t cmd_pid[CMD_MAX];
+static int   cmd_n = 0;
+
+static int player_present(void)
+{
+    return follow_player[0] != '\0';
+}
+
+/* `playerctl <verb> [arg]`, aimed at the player we're following. */
+static pid_t playerctl(const char *verb, const char *arg)
+{
+    char player[sizeof(follow_player) + 16];
+    snprintf(player, sizeof(player), "--player=%s", follow_player);
+    char *argv[] = { "playerctl", player, (char *)verb, (char *)arg,
+                     NULL };
+    return spawn(argv, NULL);
+}
+
+static void player_send(const char *method)
+{
+    if (cmd_n == CMD_MAX || !player_present()) return;
+
+    char verb[32];
+    size_t n = 0;
+    for (const char *p = method; *p && n + 2 < sizeof(verb); p++) {
+        if (isupper((unsigned char)*p) && p != method) verb[n++] = '-';
+        verb[n++] = tolower((unsigned char)*p);
+    }
+    verb[n] = '\0';
+
+    pid_t pid = playerctl(verb, NULL);
+    if (pid > 0) cmd_pid[cmd_n++] = pid;
+}
+
+/* Seeks are coalesced like the D-Bus ones: one `playerctl position`
+ * at a time, the latest target following when it exits. */
+static pid_t  seek_pid     = -1;
+static int    seek_pending = 0;
+static double seek_target  = 0;
+
+static void seek_send(void)
+{
+    char pos[32];
+    seek_pending = 0;
+    if (!player_present()) return;
+    snprintf(pos, sizeof(pos), "%.3f", seek_target);
+    seek_pid = playerctl("position", pos);
+}
+
+static void player_seek(double pos)
+{
+    seek_target = pos;
+    if (seek_pid > 0)
+        seek_pending = 1;
+    else
+        seek_send();
+}
+
+/* And volume: relative nudges summed while a `playerctl volume` runs. */
+static pid_t  volume_pid   = -1;
+static double volume_delta = 0;
+
+static void volume_send(void)
+{
+    char arg[32];
+    if (!player_present() || fabs(volume_delta) < 0.005) return;
+    snprintf(arg, sizeof(arg), "%.2f%c", fabs(volume_delta),
+             volume_delta > 0 ? '+' : '-');
+    volume_delta = 0;
+    volume_pid   = playerctl("volume", arg);
+}
+
+static void player_volume(double delta)
+{
+    volume_delta += delta;
+    if (volume_pid <= 0) volume_send();
+}
+
+static void player_reap(void)
+{
+    int failed = 0;
+    for (int i = 0; i < cmd_n; ) {
+        int status;
+        if (waitpid(cmd_pid[i], &status, WNOHANG) == cmd_pid[i]) {
+            failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+            cmd_pid[i] = cmd_pid[--cmd_n];
+        } else {
+            i++;
+        }
+    }
+    int status;
+    if (seek_pid > 0 && waitpid(seek_pid, &status, WNOHANG) == seek_pid) {
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        seek_pid = -1;
+        if (seek_pending) seek_send();
+    }
+    if (volume_pid > 0 && waitpid(volume_pid, NULL, WNOHANG) == volume_pid) {
+        volume_pid = -1;   /* failures change nothing we draw */
+        volume_send();
+    }
+    if (failed && follow_fd >= 0) {
+        follow_stop();
+        follow_start();
+    }
+}
+
+/* The follow stream re-reports the position on every change, so
+ * there's nothing better to sync against. */
+static void player_resync(void) {}
+
+static struct pollfd player_pollfd(void)
+{
+    return (struct pollfd){ .fd = follow_fd, .events = POLLIN };
+}
+
+static int player_timeout(uint64_t now)
+{
+    if (follow_fd >= 0) return -1;
+    return follow_retry <= now ? 0
+         : (int)((follow_retry - now + 999) / 1000);
+}
+
+static void player_dispatch(short revents)
+{
+    if (follow_fd < 0) {
+        if (now_us() >= follow_retry) follow_start();
+        return;
+    }
+    if (!(revents & (POLLIN | POLLHUP | POLLERR))) return;
+
+    for (;;) {
+        ssize_t n = read(follow_fd, follow_buf + follow_len,
+                         sizeof(follow_buf) - follow_len);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) break;
+        if (n <= 0) {
+            /* playerctl died (or was never installed). */
+            follow_stop();
+            memset(&state, 0, sizeof(state));
+            follow_player[0] = '\0';
+            state_dirty  = 1;
+            follow_retry = now_us() + FOLLOW_RETRY_MS * 1000ULL;
+            return;
+        }
+        follow_len += n;
+
+        /* Only the last complete line matters; older ones are
+         * already stale. */
+        char *end = memrchr(follow_buf, '\n', follow_len);
+        if (end) {
+            *end = '\0';
+            char *start = memrchr(follow_buf, '\n', end - follow_buf);
+            follow_parse(start ? start + 1 : follow_buf);
+            state_dirty = 1;
+            follow_len -= end + 1 - follow_buf;
+            memmove(follow_buf, end + 1, follow_len);
+        } else if (follow_len == sizeof(follow_buf)) {
+            follow_len = 0;   /* absurd line; drop it */
+        }
+    }
+}
+
+#endif /* NO_SDBUS */
+
+/* ── Helpers ─────────────────────────────────────────────────────────── */
+
+/*
+ * Turn a file:// URL (or a bare path) into a filesystem path, undoing
+ * the percent-encoding players are supposed to apply. Returns -1 for
+ * anything remote.
+ */
+static int url_to_path(const char *url, char *path, size_t n)
+{
+    if (strncmp(url, "file://", 7) == 0)
+        url += 7;
+    else if (strstr(url, "://") || !url[0])
+        return -1;
+
+    size_t len = 0;
+    for (const char *p = url; *p && len + 1 < n; p++) {
+        unsigned hex;
+        if (p[0] == '%' && sscanf(p + 1, "%2x", &hex) == 1 &&
+            isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])) {
+            path[len++] = (char)hex;
+            p += 2;
+        } else {
+            path[len++] = *p;
+        }
+    }
+    path[len] = '\0';
+    return 0;
+}
+
+static uint64_t fnv1a(uint64_t h, const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    while (len--) h = (h ^ *p++) * 0x100000001b3ULL;
+    return h;
+}
+
+/* ── SHM buffers ─────────────────────────────────────────────────────── */
+
+/*
+ * A few buffers carved out of one memfd-backed pool. The compositor
+ * owns a buffer from the commit that attaches it until it sends
+ * release, and we only ever draw into one it has handed back.
+ * Whichever we pick already holds the last frame, so redraw() can go
+ * on repainting just the boxes that changed.
+ */
+#define BUFFERS  3
+#define STRIDE   (WIDTH * 4)
+
+typedef struct {
+    struct wl_buffer *wl;
+    unsigned char    *data;
+    int               busy;      /* attached and not yet released */
+} Buffer;
+
+static Buffer  buffers[BUFFERS];
+static Buffer *front         = NULL;   /* holds the last frame */
+static int     buffer_wanted = 0;      /* a redraw found none free */
+
+static void buffer_release(void *data, struct wl_buffer *wl)
+{
+    Buffer *b = data;
+    b->busy = 0;
+    if (buffer_wanted) {
+        buffer_wanted = 0;
+        state_dirty   = 1;
+    }
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static int create_buffers(void)
+{
+    size_t size = (size_t)STRIDE * HEIGHT;
+    int fd = memfd_create("musicwidget", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, size * BUFFERS) < 0) {
+        close(fd);
+        return -1;
+    }
+    /* The compositor maps this too; promise it won't shrink. */
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+
+    unsigned char *map = mmap(NULL, size * BUFFERS,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    struct wl_shm_pool *pool =
+        wl_shm_create_pool(shm, fd, size * BUFFERS);
+    for (int i = 0; i < BUFFERS; i++) {
+        buffers[i].data = map + size * i;
+        buffers[i].wl   = wl_shm_pool_create_buffer(pool, size * i,
+                              WIDTH, HEIGHT, STRIDE,
+                              WL_SHM_FORMAT_ARGB8888);
+        wl_buffer_add_listener(buffers[i].wl, &buffer_listener,
+                               &buffers[i]);
+    }
+    wl_shm_pool_destroy(pool);
+    close(fd);   /* libwayland sent its own copy */
+    return 0;
+}
+
+/*
+ * A buffer to draw the next frame into, already holding the last
+ * one. Usually that's the front buffer itself, back from the
+ * compositor; otherwise a free one gets a copy of it. NULL if the
+ * compositor has them all — buffer_release() brings us back.
+ */
+static Buffer *buffer_acquire(void)
+{
+    if (front && !front->busy) return front;
+    for (int i = 0; i < BUFFERS; i++) {
+        Buffer *b = &buffers[i];
+        if (b->busy) continue;
+        if (front) memcpy(b->data, front->data, (size_t)STRIDE * HEIGHT);
+        return b;
+    }
+    buffer_wanted = 1;
+    return NULL;
+}
+
+/* ── Cursor helpers ──────────────────────────────────────────────────── */
+
+static void set_cursor(struct wl_pointer *ptr,
+                       uint32_t serial,
+                       struct wl_cursor *cur)
+{
+    if (!cur || !cursor_surface) return;
+    struct wl_cursor_image *img = cur->images[0];
+    struct wl_buffer *cur_buf = wl_cursor_image_get_buffer(img);
+    wl_pointer_set_cursor(ptr, serial, cursor_surface,
+                          img->hotspot_x, img->hotspot_y);
+    wl_surface_attach(cursor_surface, cur_buf, 0, 0);
+    wl_surface_damage(cursor_surface, 0, 0,
+                      img->width, img->height);
+    wl_surface_commit(cursor_surface);
+}
+
+/* ── Cairo drawing ───────────────────────────────────────────────────── */
+
+static void rounded_rect(cairo_t *cr,
+                          double x, double y,
+                          double w, double h, double r)
+{
+    cairo_move_to(cr, x + r, y);
+    cairo_line_to(cr, x + w - r, y);
+    cairo_arc(cr, x+w-r, y+r,   r, -M_PI/2, 0);
+    cairo_line_to(cr, x+w, y+h-r);
+    cairo_arc(cr, x+w-r, y+h-r, r,  0,       M_PI/2);
+    cairo_line_to(cr, x+r, y+h);
+    cairo_arc(cr, x+r,   y+h-r, r,  M_PI/2,  M_PI);
+    cairo_line_to(cr, x, y+r);
+    cairo_arc(cr, x+r,   y+r,   r,  M_PI,    3*M_PI/2);
+    cairo_close_path(cr);
+}
+
+/* ── Album art ───────────────────────────────────────────────────────── */
+
+/*
+ * The finished art — scaled to ART_SIZE, tinted and cut to the
+ * rounded rect — is kept until the URL or the file behind it
+ * changes, so a redraw is one paint rather than a decode. A failed
+ * load is cached too (as a NULL surface) so a broken cover doesn't
+ * get retried every frame.
+ *
+ * Loading happens on a worker thread: the main loop hands it a URL,
+ * keeps drawing whatever it had, and picks the result up when the
+ * worker pokes art_event_fd. Nothing on the UI thread ever waits on
+ * the disk or a decoder. The cache holds a few covers so the ones
+ * prefetched for upcoming tracks are there when the track changes.
+ */
+#define ART_CACHE_SLOTS  4   /* current cover, previous, prefetched */
+#define DISK_CACHE_MAX   (8 << 20)   /* bytes of thumbnails on disk */
+#define DISK_CACHE_VER   1           /* bump when rendering changes */
+
+typedef struct {
+    char             url[512];
+    struct timespec  mtime;
+    off_t            size;
+    uint64_t         cover;     /* folder art stamp, 0 if none */
+    int              track;     /* url is the track, not its art */
+    cairo_surface_t *surface;
+    int              valid;     /* mtime/size/surface are known */
+    uint64_t         used;      /* LRU stamp */
+} ArtEntry;
+
+/* Main thread only. */
+static ArtEntry         art_cache[ART_CACHE_SLOTS];
+static uint64_t         art_clock = 0;
+static cairo_surface_t *art_shown = NULL;   /* what draw_art() shows */
+static char             art_wanted[512];    /* what it should show */
+static int              art_wanted_track;
+
+/* Shared with the worker, under art_lock. The cover on screen always
+ * goes first; prefetches only run when there's nothing else to do. */
+static pthread_t       art_thread;
+static pthread_mutex_t art_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  art_wake = PTHREAD_COND_INITIALIZER;
+static int             art_event_fd = -1;
+static ArtEntry        art_job;
+static int             art_job_set  = 0;
+static char            art_ahead[PREFETCH_TRACKS][512];
+static int             art_ahead_track[PREFETCH_TRACKS];
+static int             art_ahead_n  = 0;
+static ArtEntry        art_done[ART_CACHE_SLOTS];
+static int             art_done_n   = 0;
+
+/*
+ * Decoders. Each one takes the encoded file in memory and writes
+ * straight into a cairo ARGB32 surface, or returns NULL so the
+ * caller can try something else. Where the format allows it they
+ * shrink while decoding, to the smallest size whose short side still
+ * covers min_side — a 3000² cover is never needed at full size to
+ * fill a 72² square.
+ */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define JCS_CAIRO   JCS_EXT_BGRA   /* ARGB32 as bytes: B G R A */
+#define WEBP_CAIRO  MODE_bgrA      /* same, premultiplied */
+#else
+#define JCS_CAIRO   JCS_EXT_ARGB
+#define WEBP_CAIRO  MODE_Argb
+#endif
+
+struct jpeg_err {
+    struct jpeg_error_mgr mgr;
+    jmp_buf               jmp;
+};
+
+static void jpeg_bail(j_common_ptr cinfo)
+{
+    longjmp(((struct jpeg_err *)cinfo->err)->jmp, 1);
+}
+
+static void jpeg_quiet(j_common_ptr cinfo) {}
+
+static cairo_surface_t *decode_jpeg(const unsigned char *buf, size_t len,
+                                    int min_side)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_err err;
+    cairo_surface_t *volatile img = NULL;
+
+    cinfo.err = jpeg_std_error(&err.mgr);
+    err.mgr.error_exit     = jpeg_bail;
+    err.mgr.output_message = jpeg_quiet;   /* warnings aren't fatal */
+    if (setjmp(err.jmp)) {
+        jpeg_destroy_decompress(&cinfo);
+        if (img) cairo_surface_destroy(img);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, buf, len);
+    jpeg_read_header(&cinfo, TRUE);
+
+    /* libjpeg can't turn CMYK into RGB; leave those to ffmpeg. */
+    if (cinfo.jpeg_color_space == JCS_CMYK ||
+        cinfo.jpeg_color_space == JCS_YCCK) {
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+    cinfo.out_color_space = JCS_CAIRO;
+
+    /* IDCT scaling: libjpeg-turbo decodes at M/8 of full size for
+     * free, so pick the smallest M that still covers min_side. */
+    unsigned short_side = cinfo.image_width < cinfo.image_height
+                        ? cinfo.image_width : cinfo.image_height;
+    unsigned m = (8 * (unsigned)min_side + short_side - 1) / short_side;
+    cinfo.scale_num   = m < 1 ? 1 : m > 8 ? 8 : m;
+    cinfo.scale_denom = 8;
+    cinfo.dct_method  = JDCT_ISLOW;
+    jpeg_start_decompress(&cinfo);
+
+    img = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+              cinfo.output_width, cinfo.output_height);
+    if (cairo_surface_status(img) != CAIRO_STATUS_SUCCESS)
+        longjmp(err.jmp, 1);
+    unsigned char *data = cairo_image_surface_get_data(img);
+    int stride = cairo_image_surface_get_stride(img);
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = data + (size_t)cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    cairo_surface_mark_dirty(img);
+    return img;
+}
+
+struct mem_reader {
+    const unsigned char *buf;
+    size_t               len, off;
+};
+
+static cairo_status_t mem_read(void *closure, unsigned char *out,
+                               unsigned int n)
+{
+    struct mem_reader *r = closure;
+    if (r->len - r->off < n) return CAIRO_STATUS_READ_ERROR;
+    memcpy(out, r->buf + r->off, n);
+    r->off += n;
+    return CAIRO_STATUS_SUCCESS;
+}
+
+/* cairo already links libpng; borrow its loader. PNG has no cheap
+ * way to decode small, so min_side is left to the final resample. */
+static cairo_surface_t *decode_png(const unsigned char *buf, size_t len,
+                                   int min_side)
+{
+    struct mem_reader r = { buf, len, 0 };
+    cairo_surface_t *img =
+        cairo_image_surface_create_from_png_stream(mem_read, &r);
+    if (cairo_surface_status(img) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(img);
+        return NULL;
+    }
+    return img;
+}
+
+#ifndef NO_WEBP
+static cairo_surface_t *decode_webp(const unsigned char *buf, size_t len,
+                                    int min_side)
+{
+    WebPDecoderConfig cfg;
+    if (!WebPInitDecoderConfig(&cfg) ||
+        WebPGetFeatures(buf, len, &cfg.input) != VP8_STATUS_OK)
+        return NULL;
+
+    /* libwebp scales during decode too, to any size we like. */
+    int w = cfg.input.width, h = cfg.input.height;
+    int short_side = w < h ? w : h;
+    if (short_side > min_side) {
+        w = (int)ceil((double)w * min_side / short_side);
+        h = (int)ceil((double)h * min_side / short_side);
+        cfg.options.use_scaling   = 1;
+        cfg.options.scaled_width  = w;
+        cfg.options.scaled_height = h;
+    }
+
+    cairo_surface_t *img = cairo_image_surface_create(
+        CAIRO_FORMAT_ARGB32, w, h);
+    if (cairo_surface_status(img) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(img);
+        return NULL;
+    }
+    cfg.output.colorspace         = WEBP_CAIRO;
+    cfg.output.is_external_memory = 1;
+    cfg.output.u.RGBA.rgba   = cairo_image_surface_get_data(img);
+    cfg.output.u.RGBA.stride = cairo_image_surface_get_stride(img);
+    cfg.output.u.RGBA.size   = (size_t)cfg.output.u.RGBA.stride * h;
+    if (WebPDecode(buf, len, &cfg) != VP8_STATUS_OK) {
+        cairo_surface_destroy(img);
+        return NULL;
+    }
+    cairo_surface_mark_dirty(img);
+    return img;
+}
+#endif
+
+static cairo_surface_t *decode_image(const unsigned char *buf, size_t len,
+                                     int min_side)
+{
+    if (len > 3 && memcmp(buf, "\xff\xd8\xff", 3) == 0)
+        return decode_jpeg(buf, len, min_side);
+    if (len > 8 && memcmp(buf, "\x89PNG\r\n\x1a\n", 8) == 0)
+        return decode_png(buf, len, min_side);
+#ifndef NO_WEBP
+    if (len > 12 && memcmp(buf, "RIFF", 4) == 0 &&
+        memcmp(buf + 8, "WEBP", 4) == 0)
+        return decode_webp(buf, len, min_side);
+#endif
+    return NULL;
+}
+
+/*
+ * Embedded covers. Players that only report xesam:url still usually
+ * point at a file with a picture in its tags. These walk the tag
+ * structures of an mmap()ed file, jumping over everything else, so
+ * only the pages holding the tags are ever read — never the audio.
+ *
+ * embedded_cover() returns 1 with pic and pic_len set (pointing into
+ * the file, or into *owned when the bytes had to be rebuilt), 0 for
+ * an audio file with no picture, and -1 if it isn't audio we know.
+ */
+static uint32_t be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint32_t le32(const unsigned char *p)
+{
+    return (uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+static uint32_t syncsafe32(const unsigned char *p)
+{
+    return (uint32_t)(p[0] & 0x7f) << 21 | (p[1] & 0x7f) << 14 |
+           (p[2] & 0x7f) << 7 | (p[3] & 0x7f);
+}
+
+/* ID3 unsynchronisation: every FF 00 was written for a plain FF. */
+static size_t id3_unsync(unsigned char *p, size_t len)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        p[out++] = p[i];
+        if (p[i] == 0xff && i + 1 < len && p[i + 1] == 0x00) i++;
+    }
+    return out;
+}
+
+/* Skip a text field terminated per the ID3 encoding byte. */
+static size_t id3_skip_text(const unsigned char *p, size_t len, int enc)
+{
+    size_t i = 0;
+    if (enc == 1 || enc == 2) {        /* UTF-16: 00 00 on a boundary */
+        while (i + 1 < len && (p[i] || p[i + 1])) i += 2;
+        return i + 2 <= len ? i + 2 : len;
+    }
+    while (i < len && p[i]) i++;
+    return i + 1 <= len ? i + 1 : len;
+}
+
+/* APIC (v2.3/2.4) or PIC (v2.2) body → image bytes. */
+static int id3_picture(const unsigned char *p, size_t len, int v22,
+                       const unsigned char **pic, size_t *pic_len,
+                       int *type)
+{
+    if (len < 4) return 0;
+    int    enc = p[0];
+    size_t off = 1;
+    if (v22)
+        off += 3;                           /* "JPG" / "PNG" */
+    else
+        off += id3_skip_text(p + off, len - off, 0);   /* MIME */
+    if (off >= len) return 0;
+    *type = p[off++];
+    off += id3_skip_text(p + off, len - off, enc);     /* description */
+    if (off >= len) return 0;
+    *pic     = p + off;
+    *pic_len = len - off;
+    return 1;
+}
+
+static int id3_cover(const unsigned char *buf, size_t len,
+                     const unsigned char **pic, size_t *pic_len,
+                     unsigned char **owned)
+{
+    int ver = buf[3], flags = buf[5];
+    size_t tag_len = syncsafe32(buf + 6);
+    if (ver < 2 || ver > 4 || 10 + tag_len > len) return 0;
+
+    const unsigned char *p = buf + 10;
+    unsigned char *tag_copy  = NULL;   /* whole tag, de-unsynced */
+    unsigned char *pick_copy = NULL;   /* one frame, de-unsynced */
+
+    /* Whole-tag unsynchronisation (v2.2/2.3): undo it on a copy. */
+    if ((flags & 0x80) && ver < 4) {
+        if (!(tag_copy = malloc(tag_len))) return 0;
+        memcpy(tag_copy, p, tag_len);
+        tag_len = id3_unsync(tag_copy, tag_len);
+        p = tag_copy;
+    }
+    size_t off = 0;
+    if ((flags & 0x40) && ver > 2 && tag_len >= 4)     /* extended header */
+        off = ver == 4 ? syncsafe32(p) : be32(p) + 4;
+
+    int best = -1;   /* picture type of what we have; 3 = front cover */
+    size_t hdr = ver == 2 ? 6 : 10;
+    while (best != 3 && off + hdr <= tag_len && p[off]) {
+        const unsigned char *f = p + off;
+        size_t fsize = ver == 2 ? (size_t)(f[3] << 16 | f[4] << 8 | f[5])
+                     : ver == 4 ? syncsafe32(f + 4) : be32(f + 4);
+        if (fsize > tag_len - off - hdr) break;
+        off += hdr + fsize;
+
+        int fmt = ver == 2 ? 0 : f[9];
+        if (ver == 2 ? memcmp(f, "PIC", 3) != 0 : memcmp(f, "APIC", 4) != 0)
+            continue;
+        if ((ver == 3 && (fmt & 0xc0)) || (ver == 4 && (fmt & 0x0c)))
+            continue;                           /* compressed/encrypted */
+
+        const unsigned char *body = f + hdr;
+        size_t body_len = fsize;
+        if (((ver == 3 && (fmt & 0x20)) || (ver == 4 && (fmt & 0x40))) &&
+            body_len) {                         /* group id */
+            body++;
+            body_len--;
+        }
+        if (ver == 4 && (fmt & 0x01) && body_len >= 4) {
+            body += 4;                          /* data length */
+            body_len -= 4;
+        }
+        unsigned char *frame_copy = NULL;
+        if (ver == 4 && (fmt & 0x02)) {         /* per-frame unsync */
+            if (!(frame_copy = malloc(body_len))) continue;
+            memcpy(frame_copy, body, body_len);
+            body_len = id3_unsync(frame_copy, body_len);
+            body = frame_copy;
+        }
+
+        const unsigned char *img;
+        size_t img_len;
+        int type;
+        if (id3_picture(body, body_len, ver == 2, &img, &img_len, &type) &&
+            (best < 0 || type == 3)) {
+            best     = type;
+            *pic     = img;
+            *pic_len = img_len;
+            free(pick_copy);
+            pick_copy  = frame_copy;
+            frame_copy = NULL;
+        }
+        free(frame_copy);
+    }
+
+    if (best < 0) {
+        free(tag_copy);
+        return 0;
+    }
+    *owned = pick_copy ? pick_copy : tag_copy;
+    return 1;
+}
+
+/* FLAC METADATA_BLOCK_PICTURE, also what Ogg carries in base64. */
+static int flac_picture(const unsigned char *p, size_t len,
+                        const unsigned char **pic, size_t *pic_len)
+{
+    size_t off = 4;                                 /* picture type */
+    if (off + 4 > len) return 0;
+    off += 4 + (size_t)be32(p + off);               /* MIME */
+    if (off + 4 > len) return 0;
+    off += 4 + (size_t)be32(p + off);               /* description */
+    off += 16;                                      /* w, h, depth, colours */
+    if (off + 4 > len) return 0;
+    size_t n = be32(p + off);
+    off += 4;
+    if (n > len - off) return 0;
+    *pic     = p + off;
+    *pic_len = n;
+    return 1;
+}
+
+static int flac_cover(const unsigned char *buf, size_t len,
+                      const unsigned char **pic, size_t *pic_len)
+{
+    size_t off = 4;
+    while (off + 4 <= len) {
+        int    last  = buf[off] & 0x80;
+        int    type  = buf[off] & 0x7f;
+        size_t blen  = (size_t)buf[off+1] << 16 | buf[off+2] << 8 | buf[off+3];
+        off += 4;
+        if (blen > len - off) break;
+        if (type == 6 && flac_picture(buf + off, blen, pic, pic_len))
+            return 1;
+        if (last) break;
+        off += blen;
+    }
+    return 0;
+}
+
+static size_t base64_decode(const char *in, size_t len, unsigned char *out)
+{
+    static const char tbl[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t acc = 0;
+    int bits = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < len && in[i] != '='; i++) {
+        const char *c = memchr(tbl, in[i], 64);
+        if (!c) continue;
+        acc = acc << 6 | (uint32_t)(c - tbl);
+        if ((bits += 6) >= 8) {
+            bits -= 8;
+            out[n++] = (unsigned char)(acc >> bits);
+        }
+    }
+    return n;
+}
+
+/*
+ * Ogg Vorbis / Opus: reassemble the second packet of the first
+ * stream (the comment header) from its pages, then look for a
+ * METADATA_BLOCK_PICTURE (or the older COVERART) comment.
+ */
+static int ogg_cover(const unsigned char *buf, size_t len,
+                     const unsigned char **pic, size_t *pic_len,
+                     unsigned char **owned)
+{
+    unsigned char *pkt = NULL;
+    size_t pkt_len = 0, cap = 0;
+    int    packet = 0, done = 0;
+    if (len < 27) return 0;   /* not even one page header */
+    uint32_t serial = le32(buf + 14);
+
+    for (size_t off = 0; !done && off + 27 <= len; ) {
+        const unsigned char *pg = buf + off;
+        if (memcmp(pg, "OggS", 4) != 0) break;
+        size_t nseg = pg[26];
+        if (off + 27 + nseg > len) break;
+        const unsigned char *data = pg + 27 + nseg;
+        size_t body = 0;
+        for (size_t i = 0; i < nseg; i++) body += pg[27 + i];
+        if (data + body > buf + len) break;
+
+        if (le32(pg + 14) == serial) {
+            for (size_t i = 0; i < nseg && !done; i++) {
+                size_t seg = pg[27 + i];
+                if (packet == 1 && seg) {
+                    if (pkt_len + seg > cap) {
+                        cap = (pkt_len + seg) * 2;
+                        unsigned char *np = realloc(pkt, cap);
+                        if (!np) { free(pkt); return 0; }
+                        pkt = np;
+                    }
+                    memcpy(pkt + pkt_len, data, seg);
+                    pkt_len += seg;
+                }
+                data += seg;
+                if (seg < 255 && ++packet == 2) done = 1;
+            }
+        }
+        off += 27 + nseg + body;
+    }
+    if (!done) { free(pkt); return 0; }
+
+    size_t off;
+    if (pkt_len >= 7 && memcmp(pkt, "\x03vorbis", 7) == 0)
+        off = 7;
+    else if (pkt_len >= 8 && memcmp(pkt, "OpusTags", 8) == 0)
+        off = 8;
+    else { free(pkt); return 0; }
+
+    int found = 0;
+    if (off + 4 <= pkt_len) off += 4 + (size_t)le32(pkt + off);   /* vendor */
+    if (off + 4 <= pkt_len) {
+        uint32_t count = le32(pkt + off);
+        off += 4;
+        for (uint32_t i = 0; i < count && off + 4 <= pkt_len && !found; i++) {
+            size_t clen = le32(pkt + off);
+            off += 4;
+            if (clen > pkt_len - off) break;
+            const char *c = (const char *)pkt + off;
+            static const char mbp[] = "METADATA_BLOCK_PICTURE=";
+            static const char cov[] = "COVERART=";
+            if (clen > sizeof(mbp) - 1 &&
+                strncasecmp(c, mbp, sizeof(mbp) - 1) == 0) {
+                unsigned char *raw = malloc(clen);
+                size_t n = raw ? base64_decode(c + sizeof(mbp) - 1,
+                                    clen - (sizeof(mbp) - 1), raw) : 0;
+                if (raw && flac_picture(raw, n, pic, pic_len)) {
+                    *owned = raw;
+                    found  = 1;
+                } else {
+                    free(raw);
+                }
+            } else if (clen > sizeof(cov) - 1 &&
+                       strncasecmp(c, cov, sizeof(cov) - 1) == 0) {
+                unsigned char *raw = malloc(clen);
+                if (raw) {
+                    *pic_len = base64_decode(c + sizeof(cov) - 1,
+                                   clen - (sizeof(cov) - 1), raw);
+                    *pic   = raw;
+                    *owned = raw;
+                    found  = 1;
+                }
+            }
+            off += clen;
+        }
+    }
+    free(pkt);
+    return found;
+}
+
+/* Find a child box of the given type within [p, p+len). */
+static const unsigned char *mp4_box(const unsigned char *p, size_t len,
+                                    const char *type, size_t *box_len)
+{
+    size_t off = 0;
+    while (off + 8 <= len) {
+        uint64_t size = be32(p + off);
+        size_t   hdr  = 8;
+        if (size == 1 && off + 16 <= len) {
+            size = (uint64_t)be32(p + off + 8) << 32 | be32(p + off + 12);
+            hdr  = 16;
+        } else if (size == 0) {
+            size = len - off;
+        }
+        if (size < hdr || size > len - off) return NULL;
+        if (memcmp(p + off + 4, type, 4) == 0) {
+            *box_len = size - hdr;
+            return p + off + hdr;
+        }
+        off += size;
+    }
+    return NULL;
+}
+
+/* MP4/M4A: moov/udta/meta/ilst/covr/data (meta is a full box). */
+static int mp4_cover(const unsigned char *buf, size_t len,
+                     const unsigned char **pic, size_t *pic_len)
+{
+    size_t n;
+    const unsigned char *moov = mp4_box(buf, len, "moov", &n);
+    if (!moov) return 0;
+    size_t moov_len = n;
+
+    const unsigned char *meta = NULL, *udta = mp4_box(moov, moov_len, "udta", &n);
+    if (udta) meta = mp4_box(udta, n, "meta", &n);
+    if (!meta) meta = mp4_box(moov, moov_len, "meta", &n);
+    if (!meta || n < 4) return 0;
+
+    const unsigned char *p = mp4_box(meta + 4, n - 4, "ilst", &n);
+    if (p) p = mp4_box(p, n, "covr", &n);
+    if (p) p = mp4_box(p, n, "data", &n);
+    if (!p || n <= 8) return 0;
+    *pic     = p + 8;                       /* type + locale */
+    *pic_len = n - 8;
+    return 1;
+}
+
+static int embedded_cover(const unsigned char *buf, size_t len,
+                          const unsigned char **pic, size_t *pic_len,
+                          unsigned char **owned)
+{
+    *owned = NULL;
+    if (len < 12) return -1;
+
+    if (memcmp(buf, "ID3", 3) == 0) {
+        if (id3_cover(buf, len, pic, pic_len, owned)) return 1;
+        free(*owned);
+        *owned = NULL;
+        /* The odd FLAC carries an ID3 tag in front of its own. */
+        size_t skip = 10 + syncsafe32(buf + 6);
+        if (skip + 4 < len && memcmp(buf + skip, "fLaC", 4) == 0)
+            return flac_cover(buf + skip, len - skip, pic, pic_len);
+        return 0;
+    }
+    if (memcmp(buf, "fLaC", 4) == 0)
+        return flac_cover(buf, len, pic, pic_len);
+    if (memcmp(buf, "OggS", 4) == 0)
+        return ogg_cover(buf, len, pic, pic_len, owned);
+    if (memcmp(buf + 4, "ftyp", 4) == 0)
+        return mp4_cover(buf, len, pic, pic_len);
+    if (buf[0] == 0xff && (buf[1] & 0xe0) == 0xe0)
+        return 0;                           /* bare MPEG audio */
+    return -1;
+}
+
+/*
+ * Folder art. Plenty of libraries keep the cover as cover.jpg (or
+ * folder.png, front.webp…) beside the tracks rather than inside
+ * them. Finding it means listing the directory, which on a network
+ * mount is the slow bit, so each directory is listed once and the
+ * answer — a cover or none — is kept until inotify says something
+ * with a cover-ish name changed there. The worker fills the index;
+ * the main loop reads the inotify fd and knocks entries out.
+ * (inotify only hears about changes made from this machine; a cover
+ * added from elsewhere on the NAS turns up after a restart.)
+ */
+#define FOLDER_SLOTS   16
+#define FOLDER_EVENTS  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                        IN_MOVED_TO | IN_CLOSE_WRITE |          \
+                        IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+typedef struct {
+    char     dir[PATH_MAX];
+    char     cover[NAME_MAX + 1];   /* "" if the directory has none */
+    uint64_t stamp;                 /* name, mtime and size of it */
+    int      wd;                    /* inotify watch, 0 if none */
+    int      valid;
+    unsigned gen;                   /* bumped on every invalidation */
+    uint64_t used;                  /* LRU stamp */
+} FolderEntry;
+
+static FolderEntry     folder_index[FOLDER_SLOTS];
+static uint64_t        folder_clock = 0;
+static pthread_mutex_t folder_lock  = PTHREAD_MUTEX_INITIALIZER;
+static int             folder_fd    = -1;
+
+/* 3 for cover.*, 2 folder.*, 1 front.*, 0 for anything else. */
+static int folder_rank(const char *name)
+{
+    static const char *const stems[] = { "cover", "folder", "front" };
+    static const char *const exts[]  = { "jpg", "jpeg", "png", "webp" };
+
+    const char *dot = strrchr(name, '.');
+    if (!dot) return 0;
+    int image = 0;
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+        image |= strcasecmp(dot + 1, exts[i]) == 0;
+    if (!image) return 0;
+
+    size_t stem = dot - name;
+    for (size_t i = 0; i < sizeof(stems) / sizeof(stems[0]); i++)
+        if (strlen(stems[i]) == stem &&
+            strncasecmp(name, stems[i], stem) == 0)
+            return 3 - (int)i;
+    return 0;
+}
+
+/* Worker, under folder_lock: the entry for dir, recycling the least
+ * recently used one if it isn't indexed yet. */
+static FolderEntry *folder_slot(const char *dir)
+{
+    FolderEntry *f = &folder_index[0];
+    for (int i = 0; i < FOLDER_SLOTS; i++) {
+        if (strcmp(folder_index[i].dir, dir) == 0)
+            return &folder_index[i];
+        if (folder_index[i].used < f->used)
+            f = &folder_index[i];
+    }
+
+    /* Two paths to one directory share a watch; leave it to the
+     * other. */
+    int shared = 0;
+    for (int i = 0; i < FOLDER_SLOTS; i++)
+        shared |= &folder_index[i] != f && folder_index[i].wd == f->wd;
+    if (f->wd > 0 && !shared)
+        inotify_rm_watch(folder_fd, f->wd);
+
+    memset(f, 0, sizeof(*f));
+    snprintf(f->dir, sizeof(f->dir), "%s", dir);
+    return f;
+}
+
+/*
+ * Worker: the cover beside the file at path, if there is one. Fills
+ * in its path and, if asked, a stamp that changes whenever it does.
+ * A directory is only listed when the index has no answer for it.
+ */
+static int folder_art(const char *path, char *cover, size_t n,
+                      uint64_t *stamp)
+{
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) return -1;
+    slash[slash == dir] = '\0';            /* "/x" → "/" */
+
+    char     name[NAME_MAX + 1] = "";
+    uint64_t found = 0;
+
+    pthread_mutex_lock(&folder_lock);
+    FolderEntry *f = folder_slot(dir);
+    f->used = ++folder_clock;
+    if (f->valid) {
+        memcpy(name, f->cover, sizeof(name));
+        found = f->stamp;
+        pthread_mutex_unlock(&folder_lock);
+    } else {
+        /* Watch before listing, so nothing slips in between. */
+        if (f->wd <= 0 && folder_fd >= 0)
+            f->wd = inotify_add_watch(folder_fd, dir, FOLDER_EVENTS);
+        if (f->wd < 0) f->wd = 0;
+        unsigned gen = f->gen;
+        pthread_mutex_unlock(&folder_lock);
+
+        int best = 0;
+        DIR *d = opendir(dir);
+        if (d) {
+            struct dirent *de;
+            while ((de = readdir(d))) {
+                int rank = folder_rank(de->d_name);
+                if (rank > best) {
+                    best = rank;
+                    snprintf(name, sizeof(name), "%s", de->d_name);
+                }
+            }
+            closedir(d);
+        }
+
+        struct stat st;
+        snprintf(cover, n, "%s/%s", dir, name);
+        if (!name[0] || stat(cover, &st) < 0 || !S_ISREG(st.st_mode)) {
+            name[0] = '\0';
+        } else {
+            found = fnv1a(0xcbf29ce484222325ULL, name, strlen(name));
+            found = fnv1a(found, &st.st_mtim, sizeof(st.st_mtim));
+            found = fnv1a(found, &st.st_size, sizeof(st.st_size));
+        }
+
+        /* Keep the answer only if nothing changed while we looked
+         * and there's a watch to say when something does. */
+        pthread_mutex_lock(&folder_lock);
+        if (f->gen == gen && f->wd > 0) {
+            memcpy(f->cover, name, sizeof(f->cover));
+            f->stamp = found;
+            f->valid = 1;
+        }
+        pthread_mutex_unlock(&folder_lock);
+    }
+
+    if (!name[0]) return -1;
+    snprintf(cover, n, "%s/%s", dir, name);
+    if (stamp) *stamp = found;
+    return 0;
+}
+
+/* Main loop: folder_fd is readable. Drops every index entry the
+ * events touch and has the art looked at again. */
+static void folder_collect(void)
+{
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int changed = 0;
+
+    while ((len = read(folder_fd, buf, sizeof(buf))) > 0) {
+        pthread_mutex_lock(&folder_lock);
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *ev = (const void *)p;
+            p += sizeof(*ev) + ev->len;
+
+            /* Only cover-ish names matter; the directory itself
+             * going away, or a lost event, matters for everything. */
+            int all = ev->mask & IN_Q_OVERFLOW;
+            if (!all && ev->len && !folder_rank(ev->name))
+                continue;
+            if (ev->mask & IN_MOVE_SELF)
+                inotify_rm_watch(folder_fd, ev->wd);
+
+            for (int i = 0; i < FOLDER_SLOTS; i++) {
+                FolderEntry *f = &folder_index[i];
+                if (!all && f->wd != ev->wd) continue;
+                if (ev->mask & IN_IGNORED) f->wd = 0;
+                f->valid = 0;
+                f->gen++;
+                changed = 1;
+            }
+        }
+        pthread_mutex_unlock(&folder_lock);
+    }
+
+    if (changed) {
+        art_recheck = 1;
+        state_dirty = 1;
+    }
+}
+
+/*
+ * Last resort for anything the decoders above don't speak: ffmpeg
+ * turns it into a PNG on a pipe. Remote URLs go to it as they are;
+ * local paths get a file: prefix so nothing in the name can pass for
+ * another protocol or an option.
+ */
+#define FFMPEG_TIMEOUT_MS  10000
+
+static cairo_surface_t *decode_with_ffmpeg(const char *url, int min_side)
+{
+    char input[PATH_MAX + 8];
+    char path[PATH_MAX];
+    if (url_to_path(url, path, sizeof(path)) == 0)
+        snprintf(input, sizeof(input), "file:%s", path);
+    else if (url[0])
+        snprintf(input, sizeof(input), "%s", url);
+    else
+        return NULL;
+
+    char *argv[] = { "ffmpeg", "-nostdin", "-v", "quiet", "-i", input,
+                     "-frames:v", "1", "-f", "image2pipe",
+                     "-c:v", "png", "-", NULL };
+    unsigned char *png;
+    size_t len;
+    cairo_surface_t *img = NULL;
+    if (spawn_capture(argv, FFMPEG_TIMEOUT_MS, &png, &len) == 0 && len)
+        img = decode_png(png, len, min_side);
+    free(png);
+    return img;
+}
+
+static void *map_file(const char *path, size_t *len)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *map = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+        *len = st.st_size;
+    }
+    close(fd);
+    return map;
+}
+
+/*
+ * Load art from a URL: an image, or — when the player only told us
+ * which file is playing (track) — the cover beside that file, or else
+ * the one embedded in it. A real art URL never goes looking in its
+ * directory: players drop those in /tmp and caches, next to anything.
+ */
+static cairo_surface_t *load_image(const char *url, int track,
+                                   int min_side)
+{
+    char path[PATH_MAX];
+    if (url_to_path(url, path, sizeof(path)) < 0)
+        return decode_with_ffmpeg(url, min_side);   /* remote */
+
+    size_t len;
+    unsigned char *map = map_file(path, &len);
+    if (!map) return NULL;
+
+    cairo_surface_t *img = decode_image(map, len, min_side);
+    if (!img && track) {
+        char cover[PATH_MAX];
+        size_t cover_len;
+        unsigned char *cover_map;
+        if (folder_art(path, cover, sizeof(cover), NULL) == 0 &&
+            (cover_map = map_file(cover, &cover_len))) {
+            img = decode_image(cover_map, cover_len, min_side);
+            munmap(cover_map, cover_len);
+        }
+    }
+
+    int audio = 0;
+    if (!img) {
+        /* Tag parsing hops around; don't read ahead of it. */
+        madvise(map, len, MADV_RANDOM);
+        const unsigned char *pic;
+        size_t pic_len;
+        unsigned char *owned = NULL;
+        int found = embedded_cover(map, len, &pic, &pic_len, &owned);
+        if (found > 0)
+            img = decode_image(pic, pic_len, min_side);
+        audio = found >= 0;
+        free(owned);
+    }
+    munmap(map, len);
+
+    /* ffmpeg is for odd image formats, not for demuxing audio. */
+    return img || audio ? img : decode_with_ffmpeg(url, min_side);
+}
+
+/* The tint kernels live in tint.h, where bench/tint.c can reach them. */
+static const TintMap art_tint = {
+    { COL_ART_SHADOW }, { COL_ART_HIGHLIGHT },
+};
+
+static void tint_surface(cairo_surface_t *img, const TintMap *t)
+{
+    cairo_surface_flush(img);
+    unsigned char *data = cairo_image_surface_get_data(img);
+    int stride = cairo_image_surface_get_stride(img);
+    int w = cairo_image_surface_get_width(img);
+    int h = cairo_image_surface_get_height(img);
+    for (int row = 0; row < h; row++)
+        tint_row((uint32_t *)(data + (size_t)row * stride), w, t);
+    cairo_surface_mark_dirty(img);
+}
+
+static cairo_surface_t *art_render(const char *url, int track)
+{
+    cairo_surface_t *img = load_image(url, track, ART_SIZE);
+    if (!img) return NULL;
+
+    double size = ART_SIZE;
+    int iw = cairo_image_surface_get_width(img);
+    int ih = cairo_image_surface_get_height(img);
+    double scale = fmax(size / iw, size / ih);
+
+    cairo_surface_t *tmp = cairo_image_surface_create(
+                               CAIRO_FORMAT_ARGB32,
+                               ART_SIZE, ART_SIZE);
+    cairo_t *tc = cairo_create(tmp);
+    rounded_rect(tc, 0, 0, size, size, ART_RADIUS);
+    cairo_clip(tc);
+    cairo_translate(tc, (size - iw * scale) / 2,
+                        (size - ih * scale) / 2);
+    cairo_scale(tc, scale, scale);
+    cairo_set_source_surface(tc, img, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(tc), CAIRO_FILTER_GOOD);
+    cairo_paint(tc);
+    cairo_destroy(tc);
+    cairo_surface_destroy(img);
+
+    tint_surface(tmp, &art_tint);
+    return tmp;
+}
+
+static void art_identify(ArtEntry *e)
+{
+    struct stat st;
+    char path[PATH_MAX], cover[PATH_MAX];
+    int local = url_to_path(e->url, path, sizeof(path)) == 0;
+    if (!local || stat(path, &st) < 0)
+        memset(&st, 0, sizeof(st));
+    e->mtime = st.st_mtim;
+    e->size  = st.st_size;
+
+    /* A cover.jpg appearing next to a track changes its art too. */
+    e->cover = 0;
+    if (local && e->track && folder_art(path, cover, sizeof(cover), &e->cover) == 0 &&
+        strcmp(cover, path) == 0)
+        e->cover = 0;
+}
+
+static int art_same_file(const ArtEntry *a, const ArtEntry *b)
+{
+    return a->size == b->size && a->cover == b->cover &&
+           a->track == b->track &&
+           a->mtime.tv_sec  == b->mtime.tv_sec &&
+           a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+/*
+ * On-disk cache, so a restart doesn't mean decoding every cover
+ * again. Each entry is the finished surface as raw premultiplied
+ * ARGB behind a small header, named by a hash of the source, its
+ * mtime and size, and everything that affects rendering. Loading one
+ * is an mmap wrapped straight into a cairo surface. Entries' mtimes
+ * are bumped on use; the oldest go once the directory passes
+ * DISK_CACHE_MAX. Only the worker thread touches any of this.
+ */
+typedef struct {
+    char     magic[4];     /* "MWA" + DISK_CACHE_VER */
+    uint32_t width, height, stride;
+} DiskHeader;
+
+typedef struct {
+    void  *map;
+    size_t len;
+} DiskMap;
+
+static const cairo_user_data_key_t disk_map_key;
+
+static void disk_unmap(void *data)
+{
+    DiskMap *dm = data;
+    munmap(dm->map, dm->len);
+    free(dm);
+}
+
+static int disk_cache_dir(char *dir, size_t n)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (base && base[0] == '/')
+        snprintf(dir, n, "%s/musicwidget", base);
+    else if (home)
+        snprintf(dir, n, "%s/.cache/musicwidget", home);
+    else
+        return -1;
+
+    /* mkdir -p, quietly. */
+    for (char *p = dir + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        mkdir(dir, 0700);
+        *p = '/';
+    }
+    return mkdir(dir, 0700) < 0 && errno != EEXIST ? -1 : 0;
+}
+
+static int disk_cache_path(const ArtEntry *e, char *path, size_t n)
+{
+    static char dir[PATH_MAX];
+    if (!dir[0] && disk_cache_dir(dir, sizeof(dir)) < 0) {
+        dir[0] = '\0';
+        return -1;
+    }
+
+    struct {
+        int64_t  mtime_s, mtime_ns, size;
+        uint64_t cover;
+        int32_t  track, art_size, version;
+        double   radius;
+        TintMap  tint;
+    } key;
+    memset(&key, 0, sizeof(key));
+    key.mtime_s  = e->mtime.tv_sec;
+    key.mtime_ns = e->mtime.tv_nsec;
+    key.size     = e->size;
+    key.cover    = e->cover;
+    key.track    = e->track;
+    key.art_size = ART_SIZE;
+    key.version  = DISK_CACHE_VER;
+    key.radius   = ART_RADIUS;
+    key.tint     = art_tint;
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = fnv1a(h, e->url, strlen(e->url));
+    h = fnv1a(h, &key, sizeof(key));
+    snprintf(path, n, "%s/%016llx.argb", dir, (unsigned long long)h);
+    return 0;
+}
+
+static cairo_surface_t *disk_cache_read(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    cairo_surface_t *img = NULL;
+    struct stat st;
+    DiskHeader hdr;
+    if (fstat(fd, &st) < 0 ||
+        read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        memcmp(hdr.magic, "MWA", 3) != 0 || hdr.magic[3] != DISK_CACHE_VER ||
+        hdr.stride != (uint32_t)cairo_format_stride_for_width(
+                          CAIRO_FORMAT_ARGB32, hdr.width) ||
+        (off_t)(sizeof(hdr) + (size_t)hdr.stride * hdr.height) != st.st_size)
+        goto out;
+
+    /* Private and writable so cairo can treat it as its own; pages
+     * are only ever read, so nothing is actually copied. */
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) goto out;
+
+    DiskMap *dm = malloc(sizeof(*dm));
+    img = cairo_image_surface_create_for_data(
+              (unsigned char *)map + sizeof(hdr), CAIRO_FORMAT_ARGB32,
+              hdr.width, hdr.height, hdr.stride);
+    if (!dm || cairo_surface_status(img) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(img);
+        munmap(map, st.st_size);
+        free(dm);
+        img = NULL;
+        goto out;
+    }
+    dm->map = map;
+    dm->len = st.st_size;
+    cairo_surface_set_user_data(img, &disk_map_key, dm, disk_unmap);
+
+    futimens(fd, NULL);   /* LRU: recently used */
+out:
+    close(fd);
+    return img;
+}
+
+/* Drop the least recently used entries until we're under the cap. */
+static void disk_cache_evict(const char *path)
+{
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) return;
+    *slash = '\0';
+
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    struct { char name[32]; time_t mtime; off_t size; } *ents = NULL;
+    size_t n = 0, cap = 0;
+    off_t  total = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct stat st;
+        size_t len = strlen(de->d_name);
+        if (len != 21 || strcmp(de->d_name + 16, ".argb") != 0 ||
+            fstatat(dirfd(d), de->d_name, &st, 0) < 0)
+            continue;
+        if (n == cap) {
+            void *p = realloc(ents, (cap = cap ? cap * 2 : 64) * sizeof(*ents));
+            if (!p) break;
+            ents = p;
+        }
+        memcpy(ents[n].name, de->d_name, len + 1);
+        ents[n].mtime = st.st_mtime;
+        ents[n].size  = st.st_size;
+        total += st.st_size;
+        n++;
+    }
+
+    while (total > DISK_CACHE_MAX && n > 0) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < n; i++)
+            if (ents[i].mtime < ents[oldest].mtime) oldest = i;
+        unlinkat(dirfd(d), ents[oldest].name, 0);
+        total -= ents[oldest].size;
+        ents[oldest] = ents[--n];
+    }
+    free(ents);
+    closedir(d);
+}
+
+static void disk_cache_write(const char *path, cairo_surface_t *img)
+{
+    cairo_surface_flush(img);
+    DiskHeader hdr = {
+        .magic  = { 'M', 'W', 'A', DISK_CACHE_VER },
+        .width  = cairo_image_surface_get_width(img),
+        .height = cairo_image_surface_get_height(img),
+        .stride = cairo_image_surface_get_stride(img),
+    };
+    size_t len = (size_t)hdr.stride * hdr.height;
+
+    /* Write aside and rename, so a reader never sees half a file. */
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    int ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+             write(fd, cairo_image_surface_get_data(img), len) == (ssize_t)len;
+    close(fd);
+    if (!ok || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return;
+    }
+    disk_cache_evict(path);
+}
 
-/* ── Helpers ─────────────────────────────────────────────────────────── */
+/* Everything the worker does for one cover: disk cache, else decode
+ * and render, and remember the result for next time. */
+static cairo_surface_t *art_load(const ArtEntry *e)
+{
+    char path[PATH_MAX + 32];
+    int  cacheable = disk_cache_path(e, path, sizeof(path)) == 0;
 
-static char *run_playerctl(const char *args)
-{
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd),
-             "playerctl --player=kew %s 2>/dev/null", args);
-    FILE *f = popen(cmd, "r");
-    if (!f) return strdup("");
-    char buf[1024] = {0};
-    fgets(buf, sizeof(buf), f);
-    pclose(f);
-    size_t len = strlen(buf);
-    while (len > 0 && (buf[len-1] == '\n' || buf[len-1] == '\r'))
-        buf[--len] = '\0';
-    return strdup(buf);
-}
-
-static void poll_state(void)
-{
-    char *v;
-    v = run_playerctl("metadata title");
-    strncpy(state.title,   v, 255); free(v);
-    v = run_playerctl("metadata artist");
-    strncpy(state.artist,  v, 255); free(v);
-    v = run_playerctl("metadata album");
-    strncpy(state.album,   v, 255); free(v);
-    v = run_playerctl("metadata mpris:artUrl");
-    strncpy(state.art_url, v, 511); free(v);
-    v = run_playerctl("position");
-    state.position = atof(v); free(v);
-    v = run_playerctl("metadata mpris:length");
-    state.length = atof(v) / 1000000.0; free(v);
-    v = run_playerctl("status");
-    state.playing = (strcmp(v, "Playing") == 0); free(v);
-}
-
-static char *convert_to_png(const char *url)
-{
-    const char *path = url;
-    if (strncmp(url, "file://", 7) == 0)
-        path = url + 7;
-    if (strlen(path) == 0) return NULL;
+    cairo_surface_t *img = cacheable ? disk_cache_read(path) : NULL;
+    if (img) return img;
 
-    char *tmp = strdup("/tmp/musicwidget_art_XXXXXX");
-    int fd = mkstemp(tmp);
-    if (fd < 0) { free(tmp); return NULL; }
-    close(fd);
+    img = art_render(e->url, e->track);
+    if (img && cacheable) disk_cache_write(path, img);
+    return img;
+}
 
-    char png_path[512];
-    snprintf(png_path, sizeof(png_path), "%s.png", tmp);
-    free(tmp);
+/*
+ * Worker: take the next job, stat the file, and re-render only if
+ * the job doesn't already describe this exact file (remote URLs
+ * have nothing to stat and never change).
+ */
+static void *art_worker(void *arg)
+{
+    pthread_mutex_lock(&art_lock);
+    for (;;) {
+        while (!art_job_set && !art_ahead_n)
+            pthread_cond_wait(&art_wake, &art_lock);
+
+        ArtEntry job;
+        if (art_job_set) {
+            job = art_job;
+            art_job_set = 0;
+        } else {
+            memset(&job, 0, sizeof(job));
+            memcpy(job.url, art_ahead[0], sizeof(job.url));
+            job.track = art_ahead_track[0];
+            --art_ahead_n;
+            memmove(art_ahead[0], art_ahead[1],
+                    art_ahead_n * sizeof(art_ahead[0]));
+            memmove(&art_ahead_track[0], &art_ahead_track[1],
+                    art_ahead_n * sizeof(art_ahead_track[0]));
+        }
+        pthread_mutex_unlock(&art_lock);
+
+        ArtEntry res = job;
+        art_identify(&res);
+        if (!job.valid || !art_same_file(&job, &res)) {
+            res.surface = art_load(&res);
+            res.valid   = 1;
+        } else {
+            res.valid   = 0;   /* unchanged; keep what you have */
+        }
 
-    char cmd[1024];
-    snprintf(cmd, sizeof(cmd),
-             "ffmpeg -y -i '%s' '%s' >/dev/null 2>&1", path, png_path);
-    system(cmd);
+        pthread_mutex_lock(&art_lock);
+        if (art_done_n == ART_CACHE_SLOTS) {
+            /* Main loop is behind; the oldest result is stalest. */
+            if (art_done[0].surface)
+                cairo_surface_destroy(art_done[0].surface);
+            memmove(&art_done[0], &art_done[1],
+                    --art_done_n * sizeof(art_done[0]));
+        }
+        art_done[art_done_n++] = res;
+        pthread_mutex_unlock(&art_lock);
 
-    return strdup(png_path);
+        uint64_t one = 1;
+        write(art_event_fd, &one, sizeof(one));
+        pthread_mutex_lock(&art_lock);
+    }
+    return NULL;
 }
 
-/* ── Cursor helpers ──────────────────────────────────────────────────── */
+static int art_start(void)
+{
+    art_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (art_event_fd < 0) return -1;
+    /* Without inotify the folder index just never remembers. */
+    folder_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    return pthread_create(&art_thread, NULL, art_worker, NULL) ? -1 : 0;
+}
 
-static void set_cursor(struct wl_pointer *ptr,
-                       uint32_t serial,
-                       struct wl_cursor *cur)
+static ArtEntry *art_find(const char *url, int track)
 {
-    if (!cur || !cursor_surface) return;
-    struct wl_cursor_image *img = cur->images[0];
-    struct wl_buffer *cur_buf = wl_cursor_image_get_buffer(img);
-    wl_pointer_set_cursor(ptr, serial, cursor_surface,
-                          img->hotspot_x, img->hotspot_y);
-    wl_surface_attach(cursor_surface, cur_buf, 0, 0);
-    wl_surface_damage(cursor_surface, 0, 0,
-                      img->width, img->height);
-    wl_surface_commit(cursor_surface);
+    for (int i = 0; i < ART_CACHE_SLOTS; i++)
+        if (art_cache[i].valid && art_cache[i].track == track &&
+            strcmp(art_cache[i].url, url) == 0)
+            return &art_cache[i];
+    return NULL;
 }
 
-/* ── Cairo drawing ───────────────────────────────────────────────────── */
+/* Same URL again, else a free slot, else the least recently used. */
+static ArtEntry *art_slot(const char *url, int track)
+{
+    ArtEntry *e = art_find(url, track);
+    if (e) return e;
+    e = &art_cache[0];
+    for (int i = 1; i < ART_CACHE_SLOTS && e->valid; i++)
+        if (!art_cache[i].valid || art_cache[i].used < e->used)
+            e = &art_cache[i];
+    return e;
+}
 
-static void rounded_rect(cairo_t *cr,
-                          double x, double y,
-                          double w, double h, double r)
+static void art_show(cairo_surface_t *surface)
 {
-    cairo_move_to(cr, x + r, y);
-    cairo_line_to(cr, x + w - r, y);
-    cairo_arc(cr, x+w-r, y+r,   r, -M_PI/2, 0);
-    cairo_line_to(cr, x+w, y+h-r);
-    cairo_arc(cr, x+w-r, y+h-r, r,  0,       M_PI/2);
-    cairo_line_to(cr, x+r, y+h);
-    cairo_arc(cr, x+r,   y+h-r, r,  M_PI/2,  M_PI);
-    cairo_line_to(cr, x, y+r);
-    cairo_arc(cr, x+r,   y+r,   r,  M_PI,    3*M_PI/2);
-    cairo_close_path(cr);
+    if (art_shown) cairo_surface_destroy(art_shown);
+    art_shown = surface ? cairo_surface_reference(surface) : NULL;
 }
 
-static void draw_art(cairo_t *cr,
-                     double x, double y, double size, double radius)
+static void art_request(const char *url, int track, const ArtEntry *have)
 {
-    char *png_path = convert_to_png(state.art_url);
-    cairo_surface_t *img = NULL;
+    pthread_mutex_lock(&art_lock);
+    memset(&art_job, 0, sizeof(art_job));
+    if (have) art_job = *have;
+    art_job.surface = NULL;
+    art_job.track   = track;
+    snprintf(art_job.url, sizeof(art_job.url), "%s", url);
+    art_job_set = 1;
+    pthread_cond_signal(&art_wake);
+    pthread_mutex_unlock(&art_lock);
+}
 
-    if (png_path) {
-        img = cairo_image_surface_create_from_png(png_path);
-        unlink(png_path);
-        free(png_path);
+#ifndef NO_SDBUS   /* only the TrackList code knows what's next */
+/* Warm the cache with covers we're about to need. Replaces any
+ * prefetches still queued — they were for a different position. */
+static void art_prefetch(char (*urls)[512], const int *track, int n)
+{
+    pthread_mutex_lock(&art_lock);
+    art_ahead_n = 0;
+    for (int i = 0; i < n && art_ahead_n < PREFETCH_TRACKS; i++) {
+        if (!urls[i][0] || art_find(urls[i], track[i]) ||
+            strcmp(urls[i], art_wanted) == 0)
+            continue;
+        art_ahead_track[art_ahead_n] = track[i];
+        memcpy(art_ahead[art_ahead_n++], urls[i], sizeof(art_ahead[0]));
     }
+    if (art_ahead_n) pthread_cond_signal(&art_wake);
+    pthread_mutex_unlock(&art_lock);
+}
+#endif
 
-    if (!img || cairo_surface_status(img) != CAIRO_STATUS_SUCCESS) {
-        cairo_save(cr);
-        rounded_rect(cr, x, y, size, size, radius);
-        cairo_clip(cr);
-        cairo_set_source_rgba(cr, COL_ART_BG);
-        cairo_paint(cr);
-        cairo_set_source_rgba(cr, COL_NOTE);
-        cairo_select_font_face(cr, "sans-serif",
-                               CAIRO_FONT_SLANT_NORMAL,
-                               CAIRO_FONT_WEIGHT_NORMAL);
-        cairo_set_font_size(cr, 28);
-        cairo_text_extents_t te;
-        cairo_text_extents(cr, "\xe2\x99\xaa", &te);
-        cairo_move_to(cr,
-            x + (size - te.width)  / 2 - te.x_bearing,
-            y + (size - te.height) / 2 - te.y_bearing);
-        cairo_show_text(cr, "\xe2\x99\xaa");
-        cairo_restore(cr);
-        if (img) cairo_surface_destroy(img);
-        return;
+/* Main loop: art_event_fd is readable. */
+static void art_collect(void)
+{
+    uint64_t n;
+    read(art_event_fd, &n, sizeof(n));
+
+    ArtEntry done[ART_CACHE_SLOTS];
+    pthread_mutex_lock(&art_lock);
+    int got = art_done_n;
+    memcpy(done, art_done, got * sizeof(done[0]));
+    art_done_n = 0;
+    pthread_mutex_unlock(&art_lock);
+
+    for (int i = 0; i < got; i++) {
+        if (!done[i].valid) continue;   /* unchanged */
+
+        ArtEntry *e = art_slot(done[i].url, done[i].track);
+        if (e->surface) cairo_surface_destroy(e->surface);
+        *e = done[i];
+        e->used = ++art_clock;
+
+        if (strcmp(e->url, art_wanted) == 0 &&
+            e->track == art_wanted_track) {
+            art_show(e->surface);
+            state_dirty = 1;
+        }
     }
+}
 
-    int iw = cairo_image_surface_get_width(img);
-    int ih = cairo_image_surface_get_height(img);
-    double scale = fmax(size / iw, size / ih);
-
-    cairo_surface_t *tmp = cairo_image_surface_create(
-                               CAIRO_FORMAT_ARGB32,
-                               (int)size, (int)size);
-    cairo_t *tc = cairo_create(tmp);
-    cairo_translate(tc, (size - iw * scale) / 2,
-                        (size - ih * scale) / 2);
-    cairo_scale(tc, scale, scale);
-    cairo_set_source_surface(tc, img, 0, 0);
-    cairo_paint(tc);
-    cairo_destroy(tc);
-    cairo_surface_destroy(img);
+/*
+ * Look the art up. A cached cover shows at once; anything else goes
+ * to the worker while the previous cover stays up. Either way the
+ * worker re-checks the file, in case it changed under the same name.
+ */
+static cairo_surface_t *art_get(const char *url, int track)
+{
+    if (strcmp(url, art_wanted) == 0 && track == art_wanted_track &&
+        !art_recheck)
+        return art_shown;
+    art_recheck = 0;
+    snprintf(art_wanted, sizeof(art_wanted), "%s", url);
+    art_wanted_track = track;
+
+    if (!url[0]) {
+        art_show(NULL);
+        return NULL;
+    }
 
-    cairo_surface_flush(tmp);
-    unsigned char *data = cairo_image_surface_get_data(tmp);
-    int stride = cairo_image_surface_get_stride(tmp);
-    int tw = cairo_image_surface_get_width(tmp);
-    int th = cairo_image_surface_get_height(tmp);
-
-    for (int row = 0; row < th; row++) {
-        uint32_t *px = (uint32_t *)(data + row * stride);
-        for (int col = 0; col < tw; col++) {
-            uint32_t p    = px[col];
-            uint8_t  a    = (p >> 24) & 0xff;
-            uint8_t  r    = (p >> 16) & 0xff;
-            uint8_t  g    = (p >>  8) & 0xff;
-            uint8_t  b    = (p      ) & 0xff;
-            uint8_t  grey = (uint8_t)(0.299*r + 0.587*g + 0.114*b);
-            px[col] = ((uint32_t)a    << 24) |
-                      ((uint32_t)grey << 16) |
-                      ((uint32_t)grey <<  8) |
-                      (uint32_t)grey;
-        }
-    }
-    cairo_surface_mark_dirty(tmp);
+    ArtEntry *e = art_find(url, track);
+    if (e) {
+        e->used = ++art_clock;
+        art_show(e->surface);
+    }
+    art_request(url, track, e);
+    return art_shown;
+}
 
-    cairo_save(cr);
-    rounded_rect(cr, x, y, size, size, radius);
+static void draw_placeholder(cairo_t *cr, double size, double radius)
+{
+    rounded_rect(cr, 0, 0, size, size, radius);
     cairo_clip(cr);
-    cairo_set_source_surface(cr, tmp, x, y);
+    cairo_set_source_rgba(cr, COL_ART_BG);
     cairo_paint(cr);
-    cairo_restore(cr);
-    cairo_surface_destroy(tmp);
+    cairo_set_source_rgba(cr, COL_NOTE);
+    cairo_select_font_face(cr, "sans-serif",
+                           CAIRO_FONT_SLANT_NORMAL,
+                           CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 28);
+    cairo_text_extents_t te;
+    cairo_text_extents(cr, "\xe2\x99\xaa", &te);
+    cairo_move_to(cr,
+        (size - te.width)  / 2 - te.x_bearing,
+        (size - te.height) / 2 - te.y_bearing);
+    cairo_show_text(cr, "\xe2\x99\xaa");
 }
 
 static void draw_text_clipped(cairo_t *cr, const char *text,
@@ -317,70 +2891,380 @@ static void draw_play_pause(cairo_t *cr,
     }
 }
 
-static void redraw(void)
-{
-    cairo_surface_t *cs = cairo_image_surface_create_for_data(
-        shm_data, CAIRO_FORMAT_ARGB32, WIDTH, HEIGHT, WIDTH*4);
-    cairo_t *cr = cairo_create(cs);
-
-    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_rgba(cr, 0, 0, 0, 0);
-    cairo_paint(cr);
-    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+/*
+ * Layout. Everything that can change lives in one of these boxes,
+ * and redraw() repaints — and damages — only the boxes whose
+ * contents differ from what's already in the buffer. During normal
+ * playback that's the 2px progress bar and nothing else.
+ */
+#define ART_X    14
+#define ART_Y    ((HEIGHT - ART_SIZE) / 2)
+#define TEXT_X   (ART_X + ART_SIZE + 14)
+#define TEXT_W   (BTN_CX - BTN_R - 8 - TEXT_X)
+#define BAR_Y    80
+#define BAR_H    2
+
+enum { REGION_ART, REGION_TEXT, REGION_BAR, REGION_BTN, REGION_COUNT };
+#define REGION_ALL  ((1u << REGION_COUNT) - 1)
+
+static const struct { int x, y, w, h; } region[REGION_COUNT] = {
+    [REGION_ART]  = { ART_X,  ART_Y, ART_SIZE, ART_SIZE },
+    [REGION_TEXT] = { TEXT_X, 18,    TEXT_W,   60 },
+    [REGION_BAR]  = { TEXT_X, BAR_Y, TEXT_W,   BAR_H },
+    [REGION_BTN]  = { BTN_CX - BTN_R - 1, BTN_CY - BTN_R - 1,
+                      2 * BTN_R + 2,      2 * BTN_R + 2 },
+};
 
+/*
+ * Static layers. The card, the placeholder and both faces of the
+ * button depend on nothing but compile-time constants, so they're
+ * rasterised once — the buffer scale is always 1 — and from then on
+ * copied or blitted instead of filled as paths every frame.
+ */
+static cairo_surface_t *layer_card;          /* WIDTH × HEIGHT */
+static cairo_surface_t *layer_placeholder;   /* ART_SIZE² */
+static cairo_surface_t *layer_button[2];     /* paused, playing */
+
+/* What the buffer shows right now. */
+static struct {
+    int              valid;
+    cairo_surface_t *art;          /* referenced; NULL = placeholder */
+    char             title[256];
+    char             artist[256];
+    char             album[256];
+    double           bar;          /* filled width, px */
+    int              playing;
+} drawn;
+
+static void draw_card(cairo_t *cr)
+{
     rounded_rect(cr, 0, 0, WIDTH, HEIGHT, CARD_RADIUS);
     cairo_set_source_rgba(cr, COL_BG);
     cairo_fill_preserve(cr);
     cairo_set_source_rgba(cr, COL_BORDER);
     cairo_set_line_width(cr, 1.0);
     cairo_stroke(cr);
+}
+
+static cairo_surface_t *layer_new(int w, int h, cairo_t **cr)
+{
+    cairo_surface_t *ls = cairo_image_surface_create(
+                              CAIRO_FORMAT_ARGB32, w, h);
+    *cr = cairo_create(ls);
+    return ls;
+}
+
+static void layers_init(void)
+{
+    cairo_t *cr;
+
+    layer_card = layer_new(WIDTH, HEIGHT, &cr);
+    draw_card(cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(layer_card);
+
+    layer_placeholder = layer_new(ART_SIZE, ART_SIZE, &cr);
+    draw_placeholder(cr, ART_SIZE, ART_RADIUS);
+    cairo_destroy(cr);
+
+    for (int playing = 0; playing < 2; playing++) {
+        layer_button[playing] = layer_new(region[REGION_BTN].w,
+                                          region[REGION_BTN].h, &cr);
+        draw_play_pause(cr, BTN_CX - region[REGION_BTN].x,
+                            BTN_CY - region[REGION_BTN].y,
+                            BTN_R, playing);
+        cairo_destroy(cr);
+    }
+}
 
-    double art_x = 14, art_y = (HEIGHT - ART_SIZE) / 2.0;
-    draw_art(cr, art_x, art_y, ART_SIZE, ART_RADIUS);
+/* The card template is laid out like the buffer, so putting the
+ * background back under a box is a memcpy per row. */
+static void blit_card(unsigned char *dst, int x, int y, int w, int h)
+{
+    const unsigned char *src = cairo_image_surface_get_data(layer_card);
+    int src_stride = cairo_image_surface_get_stride(layer_card);
 
-    double tx       = art_x + ART_SIZE + 14;
-    double text_max = BTN_CX - BTN_R - 8 - tx;
+    for (int row = y; row < y + h; row++)
+        memcpy(dst + (size_t)row * STRIDE + x * 4,
+               src + (size_t)row * src_stride + x * 4, (size_t)w * 4);
+}
 
+static void draw_text_block(cairo_t *cr, const char *title,
+                            const char *artist, const char *album)
+{
     cairo_select_font_face(cr, FONT_FACE,
                            CAIRO_FONT_SLANT_NORMAL,
                            CAIRO_FONT_WEIGHT_BOLD);
     cairo_set_font_size(cr, 14);
     cairo_set_source_rgba(cr, COL_TITLE);
-    draw_text_clipped(cr,
-        strlen(state.title) > 0 ? state.title : "Nothing playing",
-        tx, 38, text_max);
+    draw_text_clipped(cr, title, TEXT_X, 38, TEXT_W);
 
     cairo_select_font_face(cr, FONT_FACE,
                            CAIRO_FONT_SLANT_NORMAL,
                            CAIRO_FONT_WEIGHT_NORMAL);
     cairo_set_font_size(cr, 11);
     cairo_set_source_rgba(cr, COL_ARTIST);
-    draw_text_clipped(cr, state.artist, tx, 54, text_max);
+    draw_text_clipped(cr, artist, TEXT_X, 54, TEXT_W);
 
     cairo_set_font_size(cr, 10);
     cairo_set_source_rgba(cr, COL_ALBUM);
-    draw_text_clipped(cr, state.album, tx, 68, text_max);
+    draw_text_clipped(cr, album, TEXT_X, 68, TEXT_W);
+}
 
-    double pb_x = tx, pb_y = 80, pb_h = 2;
-    double pb_w = BTN_CX - BTN_R - 8 - pb_x;
-    double prog = state.length > 0
-                ? fmin(1.0, state.position / state.length)
-                : 0.0;
+static void draw_bar(cairo_t *cr, double fill)
+{
     cairo_set_source_rgba(cr, COL_TRACK);
-    cairo_rectangle(cr, pb_x, pb_y, pb_w, pb_h);
+    cairo_rectangle(cr, TEXT_X, BAR_Y, TEXT_W, BAR_H);
     cairo_fill(cr);
     cairo_set_source_rgba(cr, COL_FILL);
-    cairo_rectangle(cr, pb_x, pb_y, pb_w * prog, pb_h);
+    cairo_rectangle(cr, TEXT_X, BAR_Y, fill, BAR_H);
     cairo_fill(cr);
+}
+
+/*
+ * The bar moves in steps of 1/BAR_SUBPX px, anti-aliased, so a
+ * playing track needs a repaint a few times a pixel rather than on a
+ * fixed tick — a handful a second for a three-minute song, each
+ * touching a couple of pixels. bar_timeout() says how long until the
+ * next step.
+ */
+#define BAR_SUBPX  4
+
+/* While the bar is being dragged it shows where the pointer is, not
+ * what the player last said. */
+static int    scrub_active = 0;
+static double scrub_pos    = 0;   /* seconds */
+
+static double bar_fill(void)
+{
+    if (state.length <= 0) return 0;
+    double pos = scrub_active ? scrub_pos : state_position(&state);
+    double px  = TEXT_W * fmin(1.0, pos / state.length);
+    return floor(px * BAR_SUBPX) / BAR_SUBPX;
+}
+
+static int bar_timeout(void)
+{
+    if (!state.playing || state.length <= 0 || state.rate <= 0 ||
+        scrub_active)
+        return -1;
+    double px = bar_fill() + 1.0 / BAR_SUBPX;
+    if (px > TEXT_W) return -1;
+    double due = px * state.length / TEXT_W - state_position(&state);
+    return (int)fmax(1, ceil(due / state.rate * 1000));
+}
 
-    draw_play_pause(cr, BTN_CX, BTN_CY, BTN_R, state.playing);
+/*
+ * Animations. A new cover or play state crossfades over ANIM_MS, and
+ * a jump in position — a seek, a new track — glides the bar there
+ * rather than snapping. They run on now_us() and the frame
+ * callbacks: while one is going every callback draws its next step,
+ * repainting only the box it lives in.
+ */
+#define ANIM_MS    200
+#define BAR_GLIDE  2.0   /* px; smaller jumps are just playback */
+
+static struct {
+    cairo_surface_t *art_from;    /* referenced; NULL = placeholder */
+    uint64_t         art_start;   /* now_us(); 0 = idle */
+    uint64_t         btn_start;   /* fading in drawn.playing's face */
+    uint64_t         bar_start;
+    double           bar_from;
+    int              running;     /* wants the next frame */
+} anim;
+
+/* How far along an animation is, 0 → 1; 1 if it isn't running. */
+static double anim_frac(uint64_t start, uint64_t now)
+{
+    if (!start) return 1;
+    return fmin(1.0, (now - start) / (ANIM_MS * 1000.0));
+}
+
+static double ease(double t)
+{
+    return t * t * (3 - 2 * t);
+}
+
+/*
+ * Frames are paced by the compositor: each commit asks for a frame
+ * callback, and nothing else is drawn until it arrives. Changes in
+ * the meantime pile up in state_dirty and go out together. A hidden
+ * surface gets no callbacks, so the widget simply stops drawing
+ * until it's visible again.
+ */
+static int frame_pending = 0;
+
+static void frame_done(void *data, struct wl_callback *cb, uint32_t time)
+{
+    wl_callback_destroy(cb);
+    frame_pending = 0;
+    if (anim.running) state_dirty = 1;
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+/* Paint b over a with weight t; either NULL means skip it. */
+static void draw_fade(cairo_t *cr, cairo_surface_t *a, cairo_surface_t *b,
+                      double t, double x, double y)
+{
+    if (t < 1 && a) {
+        cairo_set_source_surface(cr, a, x, y);
+        cairo_paint(cr);
+    }
+    cairo_set_source_surface(cr, b, x, y);
+    cairo_paint_with_alpha(cr, t);
+}
+
+static void redraw(void)
+{
+    if (frame_pending) {
+        state_dirty = 1;   /* next callback */
+        return;
+    }
+
+    uint64_t now = now_us();
+    /* No art URL? The audio file itself may carry a cover. */
+    cairo_surface_t *art = state.art_url[0]
+                         ? art_get(state.art_url, 0)
+                         : art_get(state.track_url, 1);
+    const char *title = state.title[0] ? state.title : "Nothing playing";
+    double target = bar_fill();
+
+    unsigned dirty = drawn.valid ? 0 : REGION_ALL;
+
+    /* Start whatever the changes call for. */
+    if (art != drawn.art) {
+        dirty |= 1u << REGION_ART;
+        if (anim.art_from) cairo_surface_destroy(anim.art_from);
+        anim.art_from  = NULL;
+        anim.art_start = 0;
+        if (drawn.valid) {
+            anim.art_from  = drawn.art;   /* takes over its reference */
+            anim.art_start = now;
+        } else if (drawn.art) {
+            cairo_surface_destroy(drawn.art);
+        }
+        drawn.art = art ? cairo_surface_reference(art) : NULL;
+    }
+    if (state.playing != drawn.playing && drawn.valid) {
+        /* Flipped back mid-fade? Carry on from where it got to. */
+        double done = anim_frac(anim.btn_start, now);
+        anim.btn_start = now - (uint64_t)((1 - done) * ANIM_MS * 1000);
+    }
+    if (fabs(target - drawn.bar) > BAR_GLIDE && drawn.valid &&
+        !anim.bar_start && !scrub_active) {
+        anim.bar_from  = drawn.bar;
+        anim.bar_start = now;
+    }
+
+    double art_t = ease(anim_frac(anim.art_start, now));
+    double btn_t = ease(anim_frac(anim.btn_start, now));
+    double bar_t = ease(anim_frac(anim.bar_start, now));
+    double bar   = anim.bar_start
+                 ? anim.bar_from + (target - anim.bar_from) * bar_t
+                 : target;
+
+    if (anim.art_start)
+        dirty |= 1u << REGION_ART;
+    if (strcmp(title, drawn.title) || strcmp(state.artist, drawn.artist) ||
+        strcmp(state.album, drawn.album))
+        dirty |= 1u << REGION_TEXT;
+    if (bar != drawn.bar)
+        dirty |= 1u << REGION_BAR;
+    if (state.playing != drawn.playing || anim.btn_start)
+        dirty |= 1u << REGION_BTN;
+    if (!dirty) return;
+
+    Buffer *buf = buffer_acquire();
+    if (!buf) {
+        drawn.valid = 0;   /* start afresh once one comes back */
+        return;
+    }
+    if (!layer_card) layers_init();
+
+    /* Only the stretch of bar between the old and new ends moves. */
+    struct { int x, y, w, h; } box[REGION_COUNT];
+    memcpy(box, region, sizeof(box));
+    if (dirty != REGION_ALL) {
+        int x0 = (int)floor(fmin(bar, drawn.bar));
+        int x1 = (int)fmin(TEXT_W, ceil(fmax(bar, drawn.bar)) + 1);
+        box[REGION_BAR].x = TEXT_X + x0;
+        box[REGION_BAR].w = x1 - x0;
+    }
+
+    /* Put the background back first: the whole card, or just the
+     * boxes about to be redrawn. */
+    if (dirty == REGION_ALL) {
+        blit_card(buf->data, 0, 0, WIDTH, HEIGHT);
+        wl_surface_damage_buffer(surface, 0, 0, WIDTH, HEIGHT);
+    } else {
+        for (int i = 0; i < REGION_COUNT; i++) {
+            if (!(dirty & 1u << i)) continue;
+            blit_card(buf->data, box[i].x, box[i].y, box[i].w, box[i].h);
+            wl_surface_damage_buffer(surface, box[i].x, box[i].y,
+                                     box[i].w, box[i].h);
+        }
+    }
+
+    cairo_surface_t *cs = cairo_image_surface_create_for_data(
+        buf->data, CAIRO_FORMAT_ARGB32, WIDTH, HEIGHT, STRIDE);
+    cairo_t *cr = cairo_create(cs);
+
+    for (int i = 0; i < REGION_COUNT; i++) {
+        if (!(dirty & 1u << i)) continue;
+        cairo_save(cr);
+        cairo_rectangle(cr, box[i].x, box[i].y, box[i].w, box[i].h);
+        cairo_clip(cr);
+
+        switch (i) {
+        case REGION_ART:
+            draw_fade(cr, anim.art_from ? anim.art_from : layer_placeholder,
+                      art ? art : layer_placeholder, art_t, ART_X, ART_Y);
+            break;
+        case REGION_TEXT:
+            draw_text_block(cr, title, state.artist, state.album);
+            break;
+        case REGION_BAR:
+            draw_bar(cr, bar);
+            break;
+        case REGION_BTN:
+            draw_fade(cr, layer_button[!state.playing],
+                      layer_button[!!state.playing], btn_t,
+                      region[i].x, region[i].y);
+            break;
+        }
+        cairo_restore(cr);
+    }
 
     cairo_destroy(cr);
     cairo_surface_destroy(cs);
 
-    wl_surface_attach(surface, buffer, 0, 0);
-    wl_surface_damage(surface, 0, 0, WIDTH, HEIGHT);
+    /* Retire anything that just drew its last step. */
+    if (art_t >= 1 && anim.art_start) {
+        if (anim.art_from) cairo_surface_destroy(anim.art_from);
+        anim.art_from  = NULL;
+        anim.art_start = 0;
+    }
+    if (btn_t >= 1) anim.btn_start = 0;
+    if (bar_t >= 1) anim.bar_start = 0;
+    anim.running = anim.art_start || anim.btn_start || anim.bar_start;
+
+    snprintf(drawn.title,  sizeof(drawn.title),  "%s", title);
+    snprintf(drawn.artist, sizeof(drawn.artist), "%s", state.artist);
+    snprintf(drawn.album,  sizeof(drawn.album),  "%s", state.album);
+    drawn.bar     = bar;
+    drawn.playing = state.playing;
+    drawn.valid   = 1;
+
+    wl_callback_add_listener(wl_surface_frame(surface),
+                             &frame_listener, NULL);
+    frame_pending = 1;
+    wl_surface_attach(surface, buf->wl, 0, 0);
     wl_surface_commit(surface);
+    buf->busy = 1;
+    front     = buf;
     wl_display_flush(display);
 }
 
@@ -389,7 +3273,6 @@ static void redraw(void)
 static double   ptr_x            = 0, ptr_y = 0;
 static uint32_t ptr_enter_serial = 0;
 static uint32_t last_click_time  = 0;
-static int      suppress_poll    = 0;
 
 static int over_button(void)
 {
@@ -398,6 +3281,38 @@ static int over_button(void)
     return sqrt(dx*dx + dy*dy) <= BTN_R;
 }
 
+/*
+ * The bar is two pixels tall, which nobody can hit, so it grabs
+ * BAR_GRAB px either side. Pressing on it seeks there; dragging
+ * scrubs, redrawn locally each frame while player_seek() keeps the
+ * player from drowning in requests.
+ */
+#define BAR_GRAB  6
+
+static int over_bar(void)
+{
+    return state.length > 0 &&
+           ptr_x >= TEXT_X - BAR_GRAB && ptr_x <= TEXT_X + TEXT_W + BAR_GRAB &&
+           fabs(ptr_y - (BAR_Y + BAR_H / 2.0)) <= BAR_GRAB;
+}
+
+static void scrub_update(void)
+{
+    double f = fmin(fmax((ptr_x - TEXT_X) / TEXT_W, 0), 1);
+    scrub_pos   = f * state.length;
+    state_dirty = 1;
+    player_seek(scrub_pos);
+}
+
+static void scrub_end(void)
+{
+    if (!scrub_active) return;
+    scrub_update();
+    scrub_active = 0;
+    /* Assume it landed; the player's Seeked says otherwise if not. */
+    set_position(&state, scrub_pos);
+}
+
 static void pointer_enter(void *data, struct wl_pointer *ptr,
     uint32_t serial, struct wl_surface *surf,
     wl_fixed_t x, wl_fixed_t y)
@@ -409,26 +3324,74 @@ static void pointer_enter(void *data, struct wl_pointer *ptr,
 }
 
 static void pointer_leave(void *data, struct wl_pointer *ptr,
-    uint32_t serial, struct wl_surface *surf) {}
+    uint32_t serial, struct wl_surface *surf)
+{
+    scrub_end();   /* the release will go to someone else */
+}
 
 static void pointer_motion(void *data, struct wl_pointer *ptr,
     uint32_t time, wl_fixed_t x, wl_fixed_t y)
 {
     ptr_x = wl_fixed_to_double(x);
     ptr_y = wl_fixed_to_double(y);
-    if (over_button())
+    if (scrub_active)
+        scrub_update();
+    if (over_button() || over_bar() || scrub_active)
         set_cursor(ptr, ptr_enter_serial, cursor_pointer);
     else
         set_cursor(ptr, ptr_enter_serial, cursor_default);
 }
 
+/*
+ * Scrolling. A wheel click or a touchpad swipe arrives as a burst of
+ * axis events closed by wl_pointer.frame; they're summed here and
+ * acted on once per frame. Vertical is volume, horizontal skips —
+ * at most one skip per SKIP_MS however hard the swipe.
+ */
+#define SCROLL_STEP  15.0   /* axis units per wheel click, roughly */
+#define VOLUME_STEP  0.05   /* per click */
+#define SKIP_MS      400
+
+static struct {
+    double   value[2];      /* axis units this frame, per axis */
+    int      discrete[2];   /* wheel clicks this frame, per axis */
+    double   skip;          /* horizontal, carried across frames */
+    uint32_t time;          /* of the last axis event */
+    uint32_t skipped;       /* time of the last skip */
+} scroll;
+
+static void skip(const char *method, uint32_t time)
+{
+    if (time - scroll.skipped < SKIP_MS) return;
+    scroll.skipped = time;
+    player_send(method);
+}
+
 static void pointer_button(void *data, struct wl_pointer *ptr,
     uint32_t serial, uint32_t time,
     uint32_t button, uint32_t btn_state)
 {
-    if (btn_state != WL_POINTER_BUTTON_STATE_PRESSED || button != 0x110)
+    /* Back and forward on the side of the mouse. */
+    if ((button == 0x113 || button == 0x114) &&
+        btn_state == WL_POINTER_BUTTON_STATE_PRESSED &&
+        player_present()) {
+        skip(button == 0x114 ? "Next" : "Previous", time);
         return;
+    }
+
+    if (button != 0x110) return;
+    if (btn_state != WL_POINTER_BUTTON_STATE_PRESSED) {
+        scrub_end();
+        return;
+    }
+    if (!player_present()) return;
 
+    if (over_bar()) {
+        scrub_active   = 1;
+        anim.bar_start = 0;   /* follow the pointer, not a glide */
+        scrub_update();
+        return;
+    }
     if (!over_button()) return;
 
     /* Debounce — ignore clicks within 300ms of the last one.
@@ -437,28 +3400,62 @@ static void pointer_button(void *data, struct wl_pointer *ptr,
     if (time - last_click_time < 300) return;
     last_click_time = time;
 
-    /* Flip the icon FIRST, flush to screen immediately,
-     * THEN fire playerctl. Feels instant. Is instant.
-     * Playerctl can lumber along at its own pace. */
+    /* Flip the icon FIRST, then tell the player. Feels
+     * instant. Is instant. The player can lumber along at its
+     * own pace; its next status report has the last word. */
+    set_position(&state, state_position(&state));
     state.playing = !state.playing;
-    redraw();
-    wl_display_flush(display);
-    system("playerctl --player=kew play-pause");
-
-    /* Suppress the next few polls so playerctl has time to
-     * actually act before we ask it what it's doing. */
-    suppress_poll = 3;
+    state_dirty   = 1;
+    player_send("PlayPause");
 }
 
 static void pointer_axis(void *data, struct wl_pointer *ptr,
-    uint32_t time, uint32_t axis, wl_fixed_t value) {}
-static void pointer_frame(void *data, struct wl_pointer *ptr) {}
+    uint32_t time, uint32_t axis, wl_fixed_t value)
+{
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) return;
+    scroll.value[axis] += wl_fixed_to_double(value);
+    scroll.time = time;
+}
+
+static void pointer_axis_discrete(void *data, struct wl_pointer *ptr,
+    uint32_t axis, int32_t discrete)
+{
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) return;
+    scroll.discrete[axis] += discrete;
+}
+
+static void pointer_frame(void *data, struct wl_pointer *ptr)
+{
+    /* Wheels count clicks; touchpads only have distance. */
+    double step[2];
+    for (int i = 0; i < 2; i++) {
+        step[i] = scroll.discrete[i] ? scroll.discrete[i]
+                                     : scroll.value[i] / SCROLL_STEP;
+        scroll.value[i]    = 0;
+        scroll.discrete[i] = 0;
+    }
+    if (!player_present()) return;
+
+    double v = step[WL_POINTER_AXIS_VERTICAL_SCROLL];
+    if (v != 0)
+        player_volume(-v * VOLUME_STEP);   /* up is louder */
+
+    scroll.skip += step[WL_POINTER_AXIS_HORIZONTAL_SCROLL];
+    if (fabs(scroll.skip) >= 1) {
+        skip(scroll.skip > 0 ? "Next" : "Previous", scroll.time);
+        scroll.skip = 0;
+    }
+}
+
 static void pointer_axis_source(void *data, struct wl_pointer *ptr,
     uint32_t source) {}
+
 static void pointer_axis_stop(void *data, struct wl_pointer *ptr,
-    uint32_t time, uint32_t axis) {}
-static void pointer_axis_discrete(void *data, struct wl_pointer *ptr,
-    uint32_t axis, int32_t discrete) {}
+    uint32_t time, uint32_t axis)
+{
+    if (axis == WL_POINTER_AXIS_HORIZONTAL_SCROLL)
+        scroll.skip = 0;   /* a new swipe starts from scratch */
+}
 
 static const struct wl_pointer_listener pointer_listener = {
     .enter         = pointer_enter,
@@ -541,34 +3538,45 @@ static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
     .closed    = layer_surface_closed,
 };
 
-/* ── SHM buffer ──────────────────────────────────────────────────────── */
+/* ── Main ────────────────────────────────────────────────────────────── */
+
+enum { EV_WAYLAND, EV_PLAYER, EV_ART, EV_FOLDER, EV_TIMER, EV_SIGNAL };
 
-static struct wl_buffer *create_buffer(void)
+static int loop_add(int ep, int fd, uint32_t tag)
 {
-    int stride = WIDTH * 4;
-    int size   = stride * HEIGHT;
-    char name[32];
-    snprintf(name, sizeof(name), "/musicwidget-%d", getpid());
-    shm_fd = shm_open(name, O_CREAT | O_RDWR, 0600);
-    shm_unlink(name);
-    ftruncate(shm_fd, size);
-    shm_data = mmap(NULL, size,
-                    PROT_READ | PROT_WRITE,
-                    MAP_SHARED, shm_fd, 0);
-    struct wl_shm_pool *pool =
-        wl_shm_create_pool(shm, shm_fd, size);
-    struct wl_buffer *buf =
-        wl_shm_pool_create_buffer(pool, 0,
-            WIDTH, HEIGHT, stride,
-            WL_SHM_FORMAT_ARGB8888);
-    wl_shm_pool_destroy(pool);
-    return buf;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = tag };
+    return epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
 }
 
-/* ── Main ────────────────────────────────────────────────────────────── */
+/* Fire once in ms milliseconds; -1 disarms. */
+static void timer_arm(int tfd, int ms)
+{
+    struct itimerspec its = { 0 };
+    if (ms >= 0) {
+        its.it_value.tv_sec  = ms / 1000;
+        its.it_value.tv_nsec = ms % 1000 * 1000000L;
+        if (!ms) its.it_value.tv_nsec = 1;   /* zero would disarm */
+    }
+    timerfd_settime(tfd, 0, &its, NULL);
+}
 
 int main(void)
 {
+    /* Taken through a signalfd in the main loop. Blocked before the
+     * art thread starts, so it inherits the mask. */
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+
+    tint_init();
+    if (art_start() < 0) {
+        fprintf(stderr, "musicwidget: cannot start art loader\n");
+        return 1;
+    }
+
     display = wl_display_connect(NULL);
     if (!display) {
         fprintf(stderr, "musicwidget: cannot connect to Wayland\n");
@@ -585,6 +3593,11 @@ int main(void)
         return 1;
     }
 
+    if (player_connect() < 0) {
+        fprintf(stderr, "musicwidget: cannot connect to session bus\n");
+        return 1;
+    }
+
     cursor_theme   = wl_cursor_theme_load(NULL, 24, shm);
     cursor_pointer = wl_cursor_theme_get_cursor(cursor_theme, "pointer");
     cursor_default = wl_cursor_theme_get_cursor(cursor_theme, "default");
@@ -624,57 +3637,168 @@ int main(void)
         return 1;
     }
 
-    buffer = create_buffer();
-    poll_state();
+    if (create_buffers() < 0) {
+        fprintf(stderr, "musicwidget: cannot allocate buffers\n");
+        return 1;
+    }
     redraw();
 
     /*
-     * Main loop — use poll() on the Wayland fd so we block
-     * efficiently waiting for compositor events, but wake up
-     * at least every POLL_MS to refresh playerctl state.
+     * Main loop. Everything that can wake us sits in one epoll set:
+     * the Wayland socket, the player (the session bus, or playerctl's
+     * pipe without sd-bus), the art loader's eventfd, the folder-art
+     * inotify fd, a timerfd for scheduled work, and a signalfd so
+     * SIGINT and SIGTERM end the loop instead of the process (and
+     * SIGCHLD tells us a spawned control has finished). Wayland
+     * events are read with prepare_read/read_events, so epoll_wait()
+     * is the only place we ever block.
      *
-     * This keeps the button responsive AND the display current
-     * without busy-looping like an absolute maniac.
+     * Players signal every change except the position, which we
+     * extrapolate, so only a playing track arms the timer: for the
+     * progress bar's next step, and every SYNC_MS to check it hasn't
+     * drifted. A paused one costs nothing, and redraw() commits
+     * nothing that wouldn't change what's on screen. With a frame in
+     * flight we don't arm it for either — the callback will wake us,
+     * and if it never comes the widget isn't being shown.
      */
-    int wl_fd = wl_display_get_fd(display);
-    struct timespec last_poll_ts;
-    clock_gettime(CLOCK_MONOTONIC, &last_poll_ts);
+    int ep  = epoll_create1(EPOLL_CLOEXEC);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    int sfd = signalfd(-1, &sigs, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (ep < 0 || tfd < 0 || sfd < 0 ||
+        loop_add(ep, wl_display_get_fd(display), EV_WAYLAND) < 0 ||
+        loop_add(ep, art_event_fd, EV_ART) < 0 ||
+        loop_add(ep, tfd, EV_TIMER) < 0 ||
+        loop_add(ep, sfd, EV_SIGNAL) < 0) {
+        fprintf(stderr, "musicwidget: cannot set up event loop\n");
+        return 1;
+    }
+    if (folder_fd >= 0) loop_add(ep, folder_fd, EV_FOLDER);
+
+    int      player_fd = -1;
+    uint32_t wl_events = EPOLLIN;
+    uint64_t last_sync = now_us();
 
     while (running) {
-        /* Flush any pending outgoing requests. */
-        if (wl_display_flush(display) < 0) break;
-
-        /* Work out how long until the next playerctl poll. */
-        struct timespec now;
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        long elapsed_ms = (now.tv_sec  - last_poll_ts.tv_sec)  * 1000
-                        + (now.tv_nsec - last_poll_ts.tv_nsec) / 1000000;
-        int timeout = (int)(POLL_MS - elapsed_ms);
-        if (timeout < 0) timeout = 0;
-
-        /* Block on the Wayland fd until an event arrives or
-         * the poll timer fires — whichever comes first. */
-        struct pollfd pfd = { .fd = wl_fd, .events = POLLIN };
-        poll(&pfd, 1, timeout);
-
-        /* Dispatch whatever Wayland events are waiting. */
-        if (wl_display_dispatch(display) < 0) break;
-
-        /* Poll playerctl on schedule. */
-        clock_gettime(CLOCK_MONOTONIC, &now);
-        elapsed_ms = (now.tv_sec  - last_poll_ts.tv_sec)  * 1000
-                   + (now.tv_nsec - last_poll_ts.tv_nsec) / 1000000;
-        if (elapsed_ms >= POLL_MS) {
-            last_poll_ts = now;
-            if (suppress_poll > 0) {
-                suppress_poll--;
-            } else {
-                poll_state();
-                redraw();
+        /* Claim the right to read the socket, dispatching whatever
+         * is already queued first, then send our requests. If the
+         * socket is full, whatever didn't fit waits for it to drain:
+         * watch for EPOLLOUT until a flush gets everything out. */
+        while (wl_display_prepare_read(display) != 0)
+            wl_display_dispatch_pending(display);
+        uint32_t want = EPOLLIN;
+        if (wl_display_flush(display) < 0) {
+            if (errno != EAGAIN) {
+                wl_display_cancel_read(display);
+                break;
+            }
+            want |= EPOLLOUT;
+        }
+        if (want != wl_events) {
+            struct epoll_event ev = { .events = want,
+                                      .data.u32 = EV_WAYLAND };
+            epoll_ctl(ep, EPOLL_CTL_MOD, wl_display_get_fd(display), &ev);
+            wl_events = want;
+        }
+
+        /* Work out how long until the bar next moves, and don't
+         * sleep past anything the player side has scheduled. */
+        uint64_t now = now_us();
+        int timeout = frame_pending ? -1 : bar_timeout();
+        if (state.playing && !frame_pending) {
+            uint64_t due = last_sync + SYNC_MS * 1000;
+            int sync_ms  = due > now ? (int)((due - now + 999) / 1000) : 0;
+            if (timeout < 0 || sync_ms < timeout)
+                timeout = sync_ms;
+        }
+        int player_ms = player_timeout(now);
+        if (player_ms >= 0 && (timeout < 0 || player_ms < timeout))
+            timeout = player_ms;
+        timer_arm(tfd, timeout);
+
+        /* The player's fd, and what it's waiting for, can change
+         * from one pass to the next: sd-bus wants POLLOUT while it
+         * has output queued, and playerctl gets respawned. (POLLIN
+         * and POLLOUT have the same values as their EPOLL twins.) */
+        struct pollfd pp = player_pollfd();
+        if (pp.fd != player_fd && player_fd >= 0)
+            epoll_ctl(ep, EPOLL_CTL_DEL, player_fd, NULL);
+        if (pp.fd >= 0) {
+            struct epoll_event ev = {
+                .events = (uint16_t)pp.events, .data.u32 = EV_PLAYER,
+            };
+            if (epoll_ctl(ep, EPOLL_CTL_MOD, pp.fd, &ev) < 0)
+                epoll_ctl(ep, EPOLL_CTL_ADD, pp.fd, &ev);
+        }
+        player_fd = pp.fd;
+
+        struct epoll_event evs[8];
+        int n = epoll_wait(ep, evs, 8, -1);
+
+        int   wl_ready   = 0;
+        short player_rev = 0;
+        for (int i = 0; i < n; i++) {
+            switch (evs[i].data.u32) {
+            case EV_WAYLAND:   /* EPOLLOUT alone: flush next pass */
+                wl_ready = !!(evs[i].events & (EPOLLIN | EPOLLERR |
+                                               EPOLLHUP));
+                break;
+            case EV_PLAYER:
+                player_rev = (short)evs[i].events;
+                break;
+            case EV_ART:        /* a cover finished loading */
+                art_collect();
+                break;
+            case EV_FOLDER:     /* a cover came, changed or went */
+                folder_collect();
+                break;
+            case EV_TIMER: {
+                uint64_t ticks;
+                read(tfd, &ticks, sizeof(ticks));
+                break;
             }
+            case EV_SIGNAL: {
+                struct signalfd_siginfo si;
+                while (read(sfd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGCHLD)
+                        player_reap();
+                    else
+                        running = 0;
+                }
+                break;
+            }
+            }
+        }
+
+        /* Read the socket only if there's something on it; then
+         * dispatch everything that's queued. */
+        if (wl_ready) {
+            if (wl_display_read_events(display) < 0) break;
+        } else {
+            wl_display_cancel_read(display);
+        }
+        if (wl_display_dispatch_pending(display) < 0) break;
+
+        player_dispatch(player_rev);
+
+        /* While playing, let redraw() see whether the bar has
+         * moved, and now and then check our clock against the
+         * player's. */
+        now = now_us();
+        if (state.playing && !frame_pending) {
+            state_dirty = 1;
+            if (now - last_sync >= SYNC_MS * 1000) {
+                last_sync = now;
+                player_resync();
+            }
+        }
+
+        if (state_dirty) {
+            state_dirty = 0;
+            redraw();
         }
     }
 
     wl_cursor_theme_destroy(cursor_theme);
+    player_disconnect();
     return 0;
 }
@@ -0,0 +1,215 @@
+/*
+ * tint.h
+ * Album-art tint kernels for musicwidget.c, in a header of their own so
+ * bench/tint.c can time them without Wayland or cairo in the way.
+ */
+
+#ifndef MUSICWIDGET_TINT_H
+#define MUSICWIDGET_TINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Tint kernel. Cairo pixels are premultiplied, which is convenient:
+ * luma is linear, so the luma of a premultiplied pixel is already the
+ * premultiplied luma, and the ramp
+ *
+ *     out = shadow·a + (highlight − shadow)·luma
+ *         = shadow·(a − luma) + highlight·luma
+ *
+ * needs no division by alpha. Everything is 8.8 fixed point with
+ * BT.601 weights (77, 150, 29) and an exact round-to-nearest /255,
+ * so every path below produces bit-identical output.
+ */
+typedef struct {
+    uint16_t shadow[3];      /* r, g, b */
+    uint16_t highlight[3];
+} TintMap;
+
+static inline uint32_t div255(uint32_t v)
+{
+    v += 128;
+    return (v + (v >> 8)) >> 8;
+}
+
+static void tint_scalar(uint32_t *px, size_t n, const TintMap *t)
+{
+    /* A grey ramp comes out the same in every channel: one /255 per
+     * pixel instead of three. Black → white, the default, needs none,
+     * since div255(255·l) is l. */
+    int grey = t->shadow[0] == t->shadow[1] &&
+               t->shadow[1] == t->shadow[2] &&
+               t->highlight[0] == t->highlight[1] &&
+               t->highlight[1] == t->highlight[2];
+    uint32_t sh = t->shadow[0], hi = t->highlight[0];
+    if (grey && sh == 0 && hi == 255) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t p = px[i];
+            uint32_t a = p >> 24;
+            uint32_t l = (77*((p >> 16) & 0xff) + 150*((p >> 8) & 0xff) +
+                          29*(p & 0xff) + 128) >> 8;
+            if (l > a) l = a;
+            px[i] = (a << 24) | l * 0x010101;
+        }
+        return;
+    }
+    if (grey) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t p = px[i];
+            uint32_t a = p >> 24;
+            uint32_t l = (77*((p >> 16) & 0xff) + 150*((p >> 8) & 0xff) +
+                          29*(p & 0xff) + 128) >> 8;
+            if (l > a) l = a;
+            px[i] = (a << 24) | div255(sh*(a - l) + hi*l) * 0x010101;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        uint32_t p = px[i];
+        uint32_t a = p >> 24;
+        uint32_t r = (p >> 16) & 0xff;
+        uint32_t g = (p >>  8) & 0xff;
+        uint32_t b = (p      ) & 0xff;
+        uint32_t l = (77*r + 150*g + 29*b + 128) >> 8;
+        if (l > a) l = a;
+        uint32_t k = a - l;
+        px[i] = (a << 24) |
+                (div255(t->shadow[0]*k + t->highlight[0]*l) << 16) |
+                (div255(t->shadow[1]*k + t->highlight[1]*l) <<  8) |
+                 div255(t->shadow[2]*k + t->highlight[2]*l);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * One pixel per 32-bit lane. Channels are unpacked into the low half
+ * of each lane so the luma fits _mm_mullo_epi16, then (a − l, l) is
+ * packed into a 16-bit pair and _mm_madd_epi16 against
+ * (shadow, highlight) does both products and the sum in one go.
+ */
+__attribute__((target("sse2")))
+static void tint_sse2(uint32_t *px, size_t n, const TintMap *t)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i half = _mm_set1_epi32(128);
+    const __m128i kr   = _mm_set1_epi32(77);
+    const __m128i kg   = _mm_set1_epi32(150);
+    const __m128i kb   = _mm_set1_epi32(29);
+    __m128i c[3];
+    for (int j = 0; j < 3; j++)
+        c[j] = _mm_set1_epi32(t->shadow[j] | t->highlight[j] << 16);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((__m128i *)(px + i));
+        __m128i b = _mm_and_si128(p, mask);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+        __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), mask);
+        __m128i a = _mm_srli_epi32(p, 24);
+        __m128i l = _mm_add_epi32(
+            _mm_add_epi32(_mm_mullo_epi16(r, kr), _mm_mullo_epi16(g, kg)),
+            _mm_add_epi32(_mm_mullo_epi16(b, kb), half));
+        l = _mm_min_epi16(_mm_srli_epi32(l, 8), a);
+        __m128i kl  = _mm_or_si128(_mm_sub_epi32(a, l), _mm_slli_epi32(l, 16));
+        __m128i out = _mm_slli_epi32(a, 24);
+        for (int j = 0; j < 3; j++) {
+            __m128i v = _mm_add_epi32(_mm_madd_epi16(kl, c[j]), half);
+            v   = _mm_srli_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 8)), 8);
+            out = _mm_or_si128(out, _mm_slli_epi32(v, 16 - 8 * j));
+        }
+        _mm_storeu_si128((__m128i *)(px + i), out);
+    }
+    tint_scalar(px + i, n - i, t);
+}
+
+/* The same, eight pixels at a time. */
+__attribute__((target("avx2")))
+static void tint_avx2(uint32_t *px, size_t n, const TintMap *t)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i half = _mm256_set1_epi32(128);
+    const __m256i kr   = _mm256_set1_epi32(77);
+    const __m256i kg   = _mm256_set1_epi32(150);
+    const __m256i kb   = _mm256_set1_epi32(29);
+    __m256i c[3];
+    for (int j = 0; j < 3; j++)
+        c[j] = _mm256_set1_epi32(t->shadow[j] | t->highlight[j] << 16);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i p = _mm256_loadu_si256((__m256i *)(px + i));
+        __m256i b = _mm256_and_si256(p, mask);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 8), mask);
+        __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 16), mask);
+        __m256i a = _mm256_srli_epi32(p, 24);
+        __m256i l = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_mullo_epi16(r, kr),
+                             _mm256_mullo_epi16(g, kg)),
+            _mm256_add_epi32(_mm256_mullo_epi16(b, kb), half));
+        l = _mm256_min_epi16(_mm256_srli_epi32(l, 8), a);
+        __m256i kl  = _mm256_or_si256(_mm256_sub_epi32(a, l),
+                                      _mm256_slli_epi32(l, 16));
+        __m256i out = _mm256_slli_epi32(a, 24);
+        for (int j = 0; j < 3; j++) {
+            __m256i v = _mm256_add_epi32(_mm256_madd_epi16(kl, c[j]), half);
+            v   = _mm256_srli_epi32(
+                      _mm256_add_epi32(v, _mm256_srli_epi32(v, 8)), 8);
+            out = _mm256_or_si256(out, _mm256_slli_epi32(v, 16 - 8 * j));
+        }
+        _mm256_storeu_si256((__m256i *)(px + i), out);
+    }
+    tint_scalar(px + i, n - i, t);
+}
+
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/* vld4 splits eight pixels into B, G, R, A planes of uint8. */
+static void tint_neon(uint32_t *px, size_t n, const TintMap *t)
+{
+    uint8x8_t sh[3], hi[3];
+    for (int j = 0; j < 3; j++) {
+        sh[j] = vdup_n_u8(t->shadow[j]);
+        hi[j] = vdup_n_u8(t->highlight[j]);
+    }
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8x8x4_t p = vld4_u8((uint8_t *)(px + i));
+        uint16x8_t  w = vmull_u8(p.val[2], vdup_n_u8(77));
+        w = vmlal_u8(w, p.val[1], vdup_n_u8(150));
+        w = vmlal_u8(w, p.val[0], vdup_n_u8(29));
+        uint8x8_t l = vmin_u8(vrshrn_n_u16(w, 8), p.val[3]);
+        uint8x8_t k = vsub_u8(p.val[3], l);
+        for (int j = 0; j < 3; j++) {
+            uint16x8_t v = vmlal_u8(vmull_u8(k, sh[j]), l, hi[j]);
+            v = vaddq_u16(v, vdupq_n_u16(128));
+            p.val[2 - j] = vshrn_n_u16(vsraq_n_u16(v, v, 8), 8);
+        }
+        vst4_u8((uint8_t *)(px + i), p);
+    }
+    tint_scalar(px + i, n - i, t);
+}
+#endif
+
+static void (*tint_row)(uint32_t *, size_t, const TintMap *) = tint_scalar;
+
+/* Pick the widest kernel this CPU runs. */
+static void tint_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        tint_row = tint_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        tint_row = tint_sse2;
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    tint_row = tint_neon;
+#endif
+}
+
+#endif /* MUSICWIDGET_TINT_H */